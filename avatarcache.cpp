@@ -0,0 +1,486 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "avatarcache.hpp"
+#include "logging.hpp"
+#include "storagewriter.hpp"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QVector>
+
+#include <algorithm>
+
+static const quint32 c_avatarMagic = 0x4d534131; // MSA1
+static const QString c_avatarFileSuffix = QLatin1String(".avatar");
+
+/**
+ * File operations of an avatar cache waiting for the storage writer thread.
+ *
+ * Only the latest operation per file is kept, so a removal cancels a pending write.
+ * All the operations of the cache are flushed by a single writer task.
+ */
+class MorseAvatarWriteQueue
+{
+public:
+    enum OperationType {
+        OperationWrite,
+        OperationRemove,
+        OperationTouch,
+    };
+
+    struct Operation
+    {
+        OperationType type;
+        QByteArray data;
+    };
+
+    // Returns true if a writer task has to be enqueued to flush the operation
+    bool post(const QString &fileName, const Operation &operation);
+    // Returns true if the file has a pending write or removal
+    bool pendingData(const QString &fileName, QByteArray *data) const;
+    void flush();
+
+protected:
+    static void execute(const QString &fileName, const Operation &operation);
+    static bool lookup(const QHash<QString, Operation> &operations, const QString &fileName, QByteArray *data);
+
+    mutable QMutex m_mutex;
+    QHash<QString, Operation> m_pending;
+    QHash<QString, Operation> m_inFlight;
+    bool m_scheduled = false;
+};
+
+bool MorseAvatarWriteQueue::post(const QString &fileName, const Operation &operation)
+{
+    QMutexLocker locker(&m_mutex);
+    if (operation.type == OperationTouch) {
+        if (m_pending.contains(fileName) || m_inFlight.contains(fileName)) {
+            // A pending write sets the time anyway
+            return false;
+        }
+    }
+    m_pending.insert(fileName, operation);
+    if (m_scheduled) {
+        return false;
+    }
+    m_scheduled = true;
+    return true;
+}
+
+bool MorseAvatarWriteQueue::pendingData(const QString &fileName, QByteArray *data) const
+{
+    QMutexLocker locker(&m_mutex);
+    return lookup(m_pending, fileName, data) || lookup(m_inFlight, fileName, data);
+}
+
+bool MorseAvatarWriteQueue::lookup(const QHash<QString, Operation> &operations, const QString &fileName, QByteArray *data)
+{
+    const auto it = operations.constFind(fileName);
+    if ((it == operations.constEnd()) || (it->type == OperationTouch)) {
+        return false;
+    }
+    *data = it->data;
+    return true;
+}
+
+void MorseAvatarWriteQueue::flush()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        // The operations posted from now on need another task
+        m_scheduled = false;
+        m_inFlight.swap(m_pending);
+    }
+    for (auto it = m_inFlight.constBegin(); it != m_inFlight.constEnd(); ++it) {
+        execute(it.key(), it.value());
+    }
+    QMutexLocker locker(&m_mutex);
+    m_inFlight.clear();
+}
+
+void MorseAvatarWriteQueue::execute(const QString &fileName, const Operation &operation)
+{
+    switch (operation.type) {
+    case OperationWrite: {
+        QDir().mkpath(QFileInfo(fileName).absolutePath());
+        QFile file(fileName);
+        if (!file.open(QIODevice::WriteOnly|QIODevice::Truncate) || (file.write(operation.data) != operation.data.size())) {
+            qCWarning(lcMorseAvatars) << Q_FUNC_INFO << "Unable to write" << fileName;
+            file.close();
+            QFile::remove(fileName);
+        }
+    }
+        break;
+    case OperationRemove:
+        QFile::remove(fileName);
+        break;
+    case OperationTouch: {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+        QFile file(fileName);
+        if (file.open(QIODevice::ReadOnly)) {
+            file.setFileTime(QDateTime::currentDateTimeUtc(), QFileDevice::FileModificationTime);
+        }
+#endif
+    }
+        break;
+    }
+}
+
+/*
+ * The avatar files found by the directory scan.
+ */
+struct MorseAvatarIndex
+{
+    QStringList keys; // The oldest file first
+    QVector<qint64> sizes;
+};
+
+class MorseAvatarScanTask : public QRunnable
+{
+public:
+    MorseAvatarScanTask(MorseAvatarCache *cache, const QString &directory,
+                        const QSharedPointer<MorseAvatarIndex> &index, int generation) :
+        m_cache(cache),
+        m_directory(directory),
+        m_index(index),
+        m_generation(generation)
+    {
+    }
+
+    void run() override
+    {
+        QDir dir(m_directory);
+        const QFileInfoList files = dir.entryInfoList({ QLatin1Char('*') + c_avatarFileSuffix }, QDir::Files, QDir::Time|QDir::Reversed);
+        m_index->keys.reserve(files.count());
+        m_index->sizes.reserve(files.count());
+        for (const QFileInfo &fileInfo : files) {
+            m_index->keys.append(fileInfo.completeBaseName());
+            m_index->sizes.append(fileInfo.size());
+        }
+        // The cache waits for the pool on destruction, so the pointer is valid here
+        QMetaObject::invokeMethod(m_cache, "onScanned", Qt::QueuedConnection, Q_ARG(int, m_generation));
+    }
+
+protected:
+    MorseAvatarCache *m_cache;
+    QString m_directory;
+    QSharedPointer<MorseAvatarIndex> m_index;
+    int m_generation;
+};
+
+class MorseAvatarLoadTask : public QRunnable
+{
+public:
+    MorseAvatarLoadTask(MorseAvatarCache *cache, const QString &fileId, const QString &fileName,
+                        const QSharedPointer<MorseAvatarWriteQueue> &writeQueue) :
+        m_cache(cache),
+        m_fileId(fileId),
+        m_fileName(fileName),
+        m_writeQueue(writeQueue)
+    {
+    }
+
+    void run() override
+    {
+        QByteArray data;
+        QString mimeType;
+        const bool succeeded = read(&data, &mimeType);
+        // The cache waits for the pool on destruction, so the pointer is valid here
+        QMetaObject::invokeMethod(m_cache, "onLoaded", Qt::QueuedConnection,
+                                  Q_ARG(QString, m_fileId), Q_ARG(bool, succeeded),
+                                  Q_ARG(QByteArray, data), Q_ARG(QString, mimeType));
+    }
+
+protected:
+    bool read(QByteArray *data, QString *mimeType) const
+    {
+        QByteArray fileData;
+        if (!m_writeQueue->pendingData(m_fileName, &fileData)) {
+            QFile file(m_fileName);
+            if (!file.open(QIODevice::ReadOnly)) {
+                return false;
+            }
+            fileData = file.readAll();
+        }
+
+        QDataStream stream(fileData);
+        stream.setVersion(QDataStream::Qt_5_6);
+        quint32 magic = 0;
+        stream >> magic >> *mimeType >> *data;
+        return (stream.status() == QDataStream::Ok) && (magic == c_avatarMagic);
+    }
+
+    MorseAvatarCache *m_cache;
+    QString m_fileId;
+    QString m_fileName;
+    QSharedPointer<MorseAvatarWriteQueue> m_writeQueue;
+};
+
+MorseAvatarCache::MorseAvatarCache(QObject *parent) :
+    QObject(parent),
+    m_writeQueue(new MorseAvatarWriteQueue())
+{
+    // The scans and the reads are short, a single worker keeps them in order
+    m_pool.setMaxThreadCount(1);
+}
+
+MorseAvatarCache::~MorseAvatarCache()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+void MorseAvatarCache::setDirectory(const QString &directory)
+{
+    if (m_directory == directory) {
+        return;
+    }
+    m_directory = directory;
+    m_entries.clear();
+    m_loading.clear();
+    m_size = 0;
+    m_scanned = false;
+    ++m_generation;
+
+    if (m_directory.isEmpty()) {
+        m_scanned = true;
+        return;
+    }
+    m_scanResult = QSharedPointer<MorseAvatarIndex>::create();
+    m_pool.start(new MorseAvatarScanTask(this, m_directory, m_scanResult, m_generation));
+}
+
+void MorseAvatarCache::setSizeLimit(qint64 limit)
+{
+    m_sizeLimit = limit;
+    if (m_scanned) {
+        evict(QString());
+    }
+}
+
+/**
+ * Load the avatar of \a fileId for the \a peers.
+ *
+ * Returns false if the avatar is not cached. Otherwise the result is reported later via
+ * avatarLoaded(), or via avatarMissing() if the file turns out to be unreadable.
+ * Until the directory scan is done every avatar is taken as possibly cached.
+ */
+bool MorseAvatarCache::load(const QString &fileId, const QVector<Telegram::Peer> &peers)
+{
+    if (m_scanned && !m_entries.contains(fileKey(fileId))) {
+        return false;
+    }
+
+    const auto it = m_loading.find(fileId);
+    if (it != m_loading.end()) {
+        // The same file is already being read
+        for (const Telegram::Peer &peer : peers) {
+            if (!it->contains(peer)) {
+                it->append(peer);
+            }
+        }
+        return true;
+    }
+    m_loading.insert(fileId, peers);
+    if (m_scanned) {
+        startLoad(fileId);
+    }
+    return true;
+}
+
+void MorseAvatarCache::startLoad(const QString &fileId)
+{
+    m_pool.start(new MorseAvatarLoadTask(this, fileId, filePath(fileKey(fileId)), m_writeQueue));
+}
+
+void MorseAvatarCache::onScanned(int generation)
+{
+    if (generation != m_generation) {
+        return;
+    }
+    const QSharedPointer<MorseAvatarIndex> index = m_scanResult;
+    m_scanResult.clear();
+    m_scanned = true;
+
+    // The files found by the scan are older than the ones inserted meanwhile
+    qint64 lastUsed = -index->keys.count();
+    for (int i = 0; i < index->keys.count(); ++i) {
+        ++lastUsed;
+        if (m_entries.contains(index->keys.at(i))) {
+            continue;
+        }
+        Entry entry;
+        entry.size = index->sizes.at(i);
+        entry.lastUsed = lastUsed;
+        m_entries.insert(index->keys.at(i), entry);
+        m_size += entry.size;
+    }
+    qCDebug(lcMorseAvatars) << Q_FUNC_INFO << m_entries.count() << "avatars," << m_size << "bytes";
+    evict(QString());
+
+    // Serve the loads requested before the index was ready
+    const QStringList waiting = m_loading.keys();
+    for (const QString &fileId : waiting) {
+        if (m_entries.contains(fileKey(fileId))) {
+            startLoad(fileId);
+        } else {
+            emit avatarMissing(fileId, m_loading.take(fileId));
+        }
+    }
+}
+
+void MorseAvatarCache::onLoaded(const QString &fileId, bool succeeded, const QByteArray &data, const QString &mimeType)
+{
+    const auto it = m_loading.find(fileId);
+    if (it == m_loading.end()) {
+        // The directory is changed
+        return;
+    }
+    const QVector<Telegram::Peer> peers = it.value();
+    m_loading.erase(it);
+
+    const QString key = fileKey(fileId);
+    const auto entry = m_entries.find(key);
+    if (!succeeded) {
+        if (entry != m_entries.end()) {
+            qCWarning(lcMorseAvatars) << Q_FUNC_INFO << "Drop missing or broken avatar file" << filePath(key);
+            remove(key);
+        }
+        emit avatarMissing(fileId, peers);
+        return;
+    }
+
+    if (entry != m_entries.end()) {
+        entry->lastUsed = ++m_clock;
+        // Keep the usage order across restarts
+        scheduleTouch(key);
+    }
+    emit avatarLoaded(fileId, data, mimeType, peers);
+}
+
+void MorseAvatarCache::insert(const QString &fileId, const QByteArray &data, const QString &mimeType)
+{
+    if (m_directory.isEmpty() || data.isEmpty()) {
+        return;
+    }
+
+    QByteArray fileData;
+    QDataStream stream(&fileData, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << c_avatarMagic << mimeType << data;
+
+    const QString key = fileKey(fileId);
+    Entry &entry = m_entries[key];
+    m_size += fileData.size() - entry.size;
+    entry.size = fileData.size();
+    entry.lastUsed = ++m_clock;
+
+    scheduleWrite(key, fileData);
+    if (m_scanned) {
+        evict(key);
+    }
+}
+
+void MorseAvatarCache::scheduleWrite(const QString &key, const QByteArray &fileData)
+{
+    MorseAvatarWriteQueue::Operation operation;
+    operation.type = fileData.isNull() ? MorseAvatarWriteQueue::OperationRemove : MorseAvatarWriteQueue::OperationWrite;
+    operation.data = fileData;
+    if (m_writeQueue->post(filePath(key), operation)) {
+        enqueueFlush();
+    }
+}
+
+void MorseAvatarCache::scheduleTouch(const QString &key)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    MorseAvatarWriteQueue::Operation operation;
+    operation.type = MorseAvatarWriteQueue::OperationTouch;
+    if (m_writeQueue->post(filePath(key), operation)) {
+        enqueueFlush();
+    }
+#else
+    Q_UNUSED(key)
+#endif
+}
+
+void MorseAvatarCache::enqueueFlush()
+{
+    // All the files are flushed by one task keyed by the queue, so the avatars never fill the writer queue
+    const QSharedPointer<MorseAvatarWriteQueue> queue = m_writeQueue;
+    MorseStorageWriter::Task task;
+    task.prepare = [queue](MorseStorageBatch *) {
+        queue->flush();
+        return true;
+    };
+    MorseStorageWriter::instance()->enqueue(QLatin1String("avatars:") + QString::number(quintptr(queue.data()), 16), task);
+}
+
+void MorseAvatarCache::evict(const QString &keepKey)
+{
+    if ((m_sizeLimit <= 0) || (m_size <= m_sizeLimit)) {
+        return;
+    }
+
+    QVector<QPair<qint64, QString>> order;
+    order.reserve(m_entries.count());
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        order.append({ it->lastUsed, it.key() });
+    }
+    std::sort(order.begin(), order.end());
+
+    // Free a bit more than needed to not evict on every insertion
+    const qint64 target = m_sizeLimit - m_sizeLimit / 8;
+    for (const auto &item : order) {
+        if (m_size <= target) {
+            break;
+        }
+        if (item.second == keepKey) {
+            continue;
+        }
+        remove(item.second);
+    }
+}
+
+void MorseAvatarCache::remove(const QString &key)
+{
+    m_size -= m_entries.take(key).size;
+    // Also cancels the write of the file if it is still pending
+    scheduleWrite(key, QByteArray());
+}
+
+QString MorseAvatarCache::filePath(const QString &key) const
+{
+    return m_directory + QLatin1Char('/') + key + c_avatarFileSuffix;
+}
+
+QString MorseAvatarCache::fileKey(const QString &fileId)
+{
+    // The file id is not guaranteed to be a valid file name
+    return QString::fromLatin1(QCryptographicHash::hash(fileId.toUtf8(), QCryptographicHash::Sha1).toHex());
+}
@@ -0,0 +1,105 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MORSE_AVATAR_CACHE_HPP
+#define MORSE_AVATAR_CACHE_HPP
+
+#include <QHash>
+#include <QObject>
+#include <QSharedPointer>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+
+#include <TelegramQt/TelegramNamespace>
+
+class MorseAvatarWriteQueue;
+struct MorseAvatarIndex;
+
+/**
+ * On-disk avatar cache keyed by the Telegram file id.
+ *
+ * The file id of a peer picture is stable, so a cached avatar never needs to be revalidated.
+ * Each avatar is stored in its own file; the total size is kept below sizeLimit() by removing
+ * the least recently used files. The files are written and removed by the storage writer thread
+ * without syncing them to the disk: the cache is rebuilt from the server if the files are lost,
+ * and a file truncated by a crash fails the format check and is dropped on read. An avatar
+ * is served from memory until its file is written.
+ *
+ * The cache does no file I/O in the object thread: the in-memory index is built by scanning
+ * the directory in a worker pool, and load() reads the file in the pool as well. The result
+ * is reported via avatarLoaded() or avatarMissing().
+ */
+class MorseAvatarCache : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MorseAvatarCache(QObject *parent = nullptr);
+    ~MorseAvatarCache() override;
+
+    QString directory() const { return m_directory; }
+    void setDirectory(const QString &directory);
+
+    qint64 sizeLimit() const { return m_sizeLimit; }
+    void setSizeLimit(qint64 limit);
+
+    qint64 size() const { return m_size; }
+
+    bool load(const QString &fileId, const QVector<Telegram::Peer> &peers);
+    void insert(const QString &fileId, const QByteArray &data, const QString &mimeType);
+
+signals:
+    void avatarLoaded(const QString &fileId, const QByteArray &data, const QString &mimeType,
+                      const QVector<Telegram::Peer> &peers);
+    void avatarMissing(const QString &fileId, const QVector<Telegram::Peer> &peers);
+
+protected slots:
+    void onScanned(int generation);
+    void onLoaded(const QString &fileId, bool succeeded, const QByteArray &data, const QString &mimeType);
+
+protected:
+    struct Entry
+    {
+        qint64 size = 0;
+        qint64 lastUsed = 0;
+    };
+
+    void startLoad(const QString &fileId);
+    void scheduleWrite(const QString &key, const QByteArray &fileData);
+    void scheduleTouch(const QString &key);
+    void enqueueFlush();
+    void evict(const QString &keepKey);
+    void remove(const QString &key);
+    QString filePath(const QString &key) const;
+    static QString fileKey(const QString &fileId);
+
+    QThreadPool m_pool;
+    QString m_directory;
+    QHash<QString, Entry> m_entries; // File name to entry
+    QHash<QString, QVector<Telegram::Peer>> m_loading; // File id to the peers waiting for the data
+    QSharedPointer<MorseAvatarWriteQueue> m_writeQueue;
+    QSharedPointer<MorseAvatarIndex> m_scanResult; // Filled by the scan task
+    qint64 m_sizeLimit = 32 * 1024 * 1024;
+    qint64 m_size = 0;
+    qint64 m_clock = 0;
+    int m_generation = 0; // Incremented on the directory change to drop the stale scans
+    bool m_scanned = true; // Nothing to scan until the directory is set
+};
+
+#endif // MORSE_AVATAR_CACHE_HPP
@@ -0,0 +1,122 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "avatarscheduler.hpp"
+#include "logging.hpp"
+
+#include <TelegramQt/Client>
+#include <TelegramQt/FilesApi>
+#include <TelegramQt/FileOperation>
+
+#include <QDebug>
+#include <QIODevice>
+
+MorseAvatarScheduler::MorseAvatarScheduler(Telegram::Client::Client *client, QObject *parent) :
+    QObject(parent),
+    m_client(client)
+{
+}
+
+void MorseAvatarScheduler::setMaxConcurrentDownloads(int count)
+{
+    m_maxConcurrentDownloads = qMax(1, count);
+    startDownloads();
+}
+
+void MorseAvatarScheduler::request(const Telegram::Peer &peer, const Telegram::FileInfo &file, int priority)
+{
+    const QString fileId = file.getFileId();
+    const auto it = m_requests.find(fileId);
+    if (it != m_requests.end()) {
+        // Merge with the pending or running download of the same file
+        if (!it->peers.contains(peer)) {
+            it->peers.append(peer);
+        }
+        if (!it->running && (-priority < it->queueKey.first)) {
+            m_queue.remove(it->queueKey);
+            it->queueKey.first = -priority;
+            m_queue.insert(it->queueKey, fileId);
+        }
+        return;
+    }
+
+    Request request;
+    request.file = file;
+    request.peers.append(peer);
+    request.queueKey = QueueKey(-priority, ++m_sequence);
+    m_requests.insert(fileId, request);
+    m_queue.insert(request.queueKey, fileId);
+
+    startDownloads();
+}
+
+/**
+ * Forget the pending requests.
+ *
+ * The running downloads are not aborted, but their results are not reported.
+ */
+void MorseAvatarScheduler::clear()
+{
+    m_requests.clear();
+    m_queue.clear();
+}
+
+void MorseAvatarScheduler::startDownloads()
+{
+    while ((m_running < m_maxConcurrentDownloads) && !m_queue.isEmpty()) {
+        const QString fileId = m_queue.take(m_queue.firstKey());
+        Request &request = m_requests[fileId];
+        request.running = true;
+        ++m_running;
+
+        Telegram::Client::FileOperation *fileOperation = m_client->filesApi()->downloadFile(&request.file);
+        fileOperation->connectToFinished(this, &MorseAvatarScheduler::onDownloadFinished,
+                                         fileOperation, fileId);
+    }
+}
+
+void MorseAvatarScheduler::onDownloadFinished(Telegram::Client::FileOperation *fileOperation, const QString &fileId)
+{
+    qCDebug(lcMorseAvatars) << Q_FUNC_INFO << fileId << fileOperation;
+    fileOperation->deleteLater();
+    --m_running;
+
+    const auto it = m_requests.find(fileId);
+    if ((it == m_requests.end()) || !it->running) {
+        // The request was cleared while the file was being downloaded
+        startDownloads();
+        return;
+    }
+    const Request request = *it;
+    m_requests.erase(it);
+
+    if (fileOperation->isFailed()) {
+        qCWarning(lcMorseAvatars) << Q_FUNC_INFO << "Operation failed:" << fileOperation->errorDetails();
+        // It seems that the Telepathy spec doesn't cover avatar request fails. It says:
+        //    If the handles are valid but retrieving an avatar fails (for any reason, including
+        //    the contact not having an avatar) the AvatarRetrieved signal is not emitted for
+        //    that contact.
+        // Do nothing but the warning.
+    } else {
+        const QByteArray data = fileOperation->device()->readAll();
+        emit avatarDownloaded(fileId, data, fileOperation->fileInfo()->mimeType(), request.peers);
+    }
+
+    startDownloads();
+}
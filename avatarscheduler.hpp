@@ -0,0 +1,91 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MORSE_AVATAR_SCHEDULER_HPP
+#define MORSE_AVATAR_SCHEDULER_HPP
+
+#include <QHash>
+#include <QMap>
+#include <QObject>
+#include <QPair>
+#include <QVector>
+
+#include <TelegramQt/TelegramNamespace>
+
+namespace Telegram {
+
+namespace Client {
+
+class Client;
+class FileOperation;
+
+} // Client namespace
+
+} // Telegram namespace
+
+/**
+ * Avatar download queue.
+ *
+ * Requests for the same file id are merged into a single download. At most
+ * maxConcurrentDownloads() files are downloaded at once; the pending requests are
+ * started in the order of their priority and then in the order of submission.
+ * A request is forgotten as soon as its download is finished.
+ */
+class MorseAvatarScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MorseAvatarScheduler(Telegram::Client::Client *client, QObject *parent = nullptr);
+
+    int maxConcurrentDownloads() const { return m_maxConcurrentDownloads; }
+    void setMaxConcurrentDownloads(int count);
+
+    int pendingCount() const { return m_queue.count(); }
+    int runningCount() const { return m_running; }
+
+    void request(const Telegram::Peer &peer, const Telegram::FileInfo &file, int priority = 0);
+    void clear();
+
+signals:
+    void avatarDownloaded(const QString &fileId, const QByteArray &data, const QString &mimeType,
+                          const QVector<Telegram::Peer> &peers);
+
+protected:
+    using QueueKey = QPair<int, quint64>; // Negated priority, sequence number
+
+    struct Request
+    {
+        Telegram::FileInfo file;
+        QVector<Telegram::Peer> peers;
+        QueueKey queueKey;
+        bool running = false;
+    };
+
+    void startDownloads();
+    void onDownloadFinished(Telegram::Client::FileOperation *fileOperation, const QString &fileId);
+
+    Telegram::Client::Client *m_client = nullptr;
+    QHash<QString, Request> m_requests; // File id to the pending or running request
+    QMap<QueueKey, QString> m_queue; // Pending file ids
+    quint64 m_sequence = 0;
+    int m_maxConcurrentDownloads = 4;
+    int m_running = 0;
+};
+
+#endif // MORSE_AVATAR_SCHEDULER_HPP
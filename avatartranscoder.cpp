@@ -0,0 +1,203 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "avatartranscoder.hpp"
+#include "logging.hpp"
+
+#include <QBuffer>
+#include <QDebug>
+#include <QImage>
+#include <QImageReader>
+#include <QRunnable>
+
+static const QString c_jpegMimeType = QLatin1String("image/jpeg");
+static const QString c_pngMimeType = QLatin1String("image/png");
+static const int c_maxWorkers = 2;
+static const int c_minQuality = 30;
+
+class MorseAvatarTranscodeTask : public QRunnable
+{
+public:
+    MorseAvatarTranscodeTask(MorseAvatarTranscoder *transcoder, const QString &fileId,
+                             const QByteArray &data, const QString &mimeType,
+                             int maxWidth, int maxHeight, int maxBytes, const QStringList &mimeTypes) :
+        m_transcoder(transcoder),
+        m_fileId(fileId),
+        m_data(data),
+        m_mimeType(mimeType),
+        m_maxWidth(maxWidth),
+        m_maxHeight(maxHeight),
+        m_maxBytes(maxBytes),
+        m_mimeTypes(mimeTypes)
+    {
+    }
+
+    void run() override
+    {
+        QByteArray output;
+        QString outputMimeType;
+        if (!MorseAvatarTranscoder::transcodeImage(m_data, m_mimeType, m_maxWidth, m_maxHeight, m_maxBytes, m_mimeTypes,
+                                                   &output, &outputMimeType)) {
+            qCWarning(lcMorseAvatars) << Q_FUNC_INFO << "Unable to transcode avatar" << m_fileId;
+            // Better an oversized avatar than no avatar
+            output = m_data;
+            outputMimeType = m_mimeType;
+        }
+        // The transcoder waits for the pool on destruction, so the pointer is valid here
+        QMetaObject::invokeMethod(m_transcoder, "onTranscoded", Qt::QueuedConnection,
+                                  Q_ARG(QString, m_fileId), Q_ARG(QByteArray, output), Q_ARG(QString, outputMimeType));
+    }
+
+protected:
+    MorseAvatarTranscoder *m_transcoder;
+    QString m_fileId;
+    QByteArray m_data;
+    QString m_mimeType;
+    int m_maxWidth;
+    int m_maxHeight;
+    int m_maxBytes;
+    QStringList m_mimeTypes;
+};
+
+MorseAvatarTranscoder::MorseAvatarTranscoder(QObject *parent) :
+    QObject(parent)
+{
+    m_pool.setMaxThreadCount(c_maxWorkers);
+}
+
+MorseAvatarTranscoder::~MorseAvatarTranscoder()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+void MorseAvatarTranscoder::setLimits(int maxWidth, int maxHeight, int maxBytes)
+{
+    m_maxWidth = maxWidth;
+    m_maxHeight = maxHeight;
+    m_maxBytes = maxBytes;
+}
+
+void MorseAvatarTranscoder::setMimeTypes(const QStringList &mimeTypes)
+{
+    m_mimeTypes = mimeTypes;
+}
+
+void MorseAvatarTranscoder::transcode(const QString &fileId, const QByteArray &data, const QString &mimeType,
+                                      const QVector<Telegram::Peer> &peers)
+{
+    const auto it = m_pending.find(fileId);
+    if (it != m_pending.end()) {
+        // The same file is already being transcoded
+        for (const Telegram::Peer &peer : peers) {
+            if (!it->contains(peer)) {
+                it->append(peer);
+            }
+        }
+        return;
+    }
+    m_pending.insert(fileId, peers);
+    m_pool.start(new MorseAvatarTranscodeTask(this, fileId, data, mimeType, m_maxWidth, m_maxHeight, m_maxBytes, m_mimeTypes));
+}
+
+void MorseAvatarTranscoder::onTranscoded(const QString &fileId, const QByteArray &data, const QString &mimeType)
+{
+    const QVector<Telegram::Peer> peers = m_pending.take(fileId);
+    emit avatarReady(fileId, data, mimeType, peers);
+}
+
+/**
+ * Downscale and re-encode \a data to fit into the limits and the supported \a mimeTypes.
+ *
+ * Zero limit means no limit, empty \a mimeTypes means any type.
+ * Returns false if the data is not a readable image.
+ */
+bool MorseAvatarTranscoder::transcodeImage(const QByteArray &data, const QString &mimeType,
+                                           int maxWidth, int maxHeight, int maxBytes, const QStringList &mimeTypes,
+                                           QByteArray *output, QString *outputMimeType)
+{
+    QBuffer inputBuffer;
+    inputBuffer.setData(data);
+    inputBuffer.open(QIODevice::ReadOnly);
+    QImageReader reader(&inputBuffer);
+    const QSize size = reader.size();
+
+    QString inputMimeType = mimeType;
+    if (inputMimeType.isEmpty()) {
+        // Detect the type by the content
+        const QByteArray format = reader.format();
+        inputMimeType = QLatin1String("image/") + QString::fromLatin1(format == "jpg" ? QByteArray("jpeg") : format);
+    }
+
+    const bool fitsSize = size.isValid()
+            && (!maxWidth || (size.width() <= maxWidth))
+            && (!maxHeight || (size.height() <= maxHeight));
+    const bool fitsBytes = !maxBytes || (data.size() <= maxBytes);
+    const bool fitsType = mimeTypes.isEmpty() || mimeTypes.contains(inputMimeType);
+    if (fitsSize && fitsBytes && fitsType) {
+        *output = data;
+        *outputMimeType = inputMimeType;
+        return true;
+    }
+
+    QImage image;
+    if (!reader.read(&image)) {
+        return false;
+    }
+
+    // JPEG has no alpha channel, so keep the transparent images in PNG if it is supported
+    const bool keepAlpha = image.hasAlphaChannel() && (mimeTypes.isEmpty() || mimeTypes.contains(c_pngMimeType));
+    const char *format = keepAlpha ? "PNG" : "JPEG";
+    const QString formatMimeType = keepAlpha ? c_pngMimeType : c_jpegMimeType;
+
+    QSize targetSize = image.size();
+    targetSize.scale(maxWidth ? maxWidth : targetSize.width(),
+                     maxHeight ? maxHeight : targetSize.height(),
+                     Qt::KeepAspectRatio);
+    targetSize = targetSize.boundedTo(image.size());
+
+    QByteArray result;
+    forever {
+        const QImage scaled = (targetSize == image.size()) ? image
+                                                           : image.scaled(targetSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        for (int quality = 90; quality >= c_minQuality; quality -= 15) {
+            result.clear();
+            QBuffer outputBuffer(&result);
+            outputBuffer.open(QIODevice::WriteOnly);
+            // The PNG quality only sets the compression level
+            if (!scaled.save(&outputBuffer, format, quality)) {
+                return false;
+            }
+            if (!maxBytes || (result.size() <= maxBytes)) {
+                *output = result;
+                *outputMimeType = formatMimeType;
+                return true;
+            }
+        }
+        if ((targetSize.width() <= 16) || (targetSize.height() <= 16)) {
+            break;
+        }
+        // Even the lowest quality is too large; trade the resolution
+        targetSize *= 0.75;
+    }
+
+    *output = result;
+    *outputMimeType = formatMimeType;
+    return true;
+}
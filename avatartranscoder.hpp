@@ -0,0 +1,72 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MORSE_AVATAR_TRANSCODER_HPP
+#define MORSE_AVATAR_TRANSCODER_HPP
+
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+
+#include <TelegramQt/TelegramNamespace>
+
+/**
+ * Fits downloaded avatars into the advertised avatar requirements.
+ *
+ * The images which exceed the size or the byte limit or have an unsupported type are
+ * downscaled and re-encoded in a worker pool: as PNG if the image has an alpha channel
+ * and PNG is supported, as JPEG otherwise. The compliant images are passed through as is.
+ * The result is reported in the object thread via avatarReady().
+ */
+class MorseAvatarTranscoder : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MorseAvatarTranscoder(QObject *parent = nullptr);
+    ~MorseAvatarTranscoder() override;
+
+    void setLimits(int maxWidth, int maxHeight, int maxBytes);
+    void setMimeTypes(const QStringList &mimeTypes);
+
+    void transcode(const QString &fileId, const QByteArray &data, const QString &mimeType,
+                   const QVector<Telegram::Peer> &peers);
+
+    static bool transcodeImage(const QByteArray &data, const QString &mimeType,
+                               int maxWidth, int maxHeight, int maxBytes, const QStringList &mimeTypes,
+                               QByteArray *output, QString *outputMimeType);
+
+signals:
+    void avatarReady(const QString &fileId, const QByteArray &data, const QString &mimeType,
+                     const QVector<Telegram::Peer> &peers);
+
+protected slots:
+    void onTranscoded(const QString &fileId, const QByteArray &data, const QString &mimeType);
+
+protected:
+    QThreadPool m_pool;
+    QHash<QString, QVector<Telegram::Peer>> m_pending; // File id to the peers waiting for the result
+    int m_maxWidth = 0;
+    int m_maxHeight = 0;
+    int m_maxBytes = 0;
+    QStringList m_mimeTypes; // Supported by the clients, any if empty
+};
+
+#endif // MORSE_AVATAR_TRANSCODER_HPP
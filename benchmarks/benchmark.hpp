@@ -0,0 +1,46 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MORSE_BENCHMARK_HPP
+#define MORSE_BENCHMARK_HPP
+
+#include <QElapsedTimer>
+#include <QString>
+
+/**
+ * Helpers of the morse-bench executable.
+ *
+ * Each benchmark prints its results as "name: value unit" lines, so the runs of two
+ * builds can be diffed. The benchmarks use synthetic data and do not touch the network.
+ */
+namespace MorseBenchmark {
+
+void reportTime(const QString &name, const QElapsedTimer &timer, qint64 operations);
+void reportValue(const QString &name, qint64 value, const char *unit);
+
+// Keeps the computed value observable, so the measured code is not optimized out
+void consume(quint64 value);
+
+} // MorseBenchmark namespace
+
+void benchmarkChannelDispatch();
+void benchmarkHandleRegistry();
+void benchmarkStateJournal();
+
+#endif // MORSE_BENCHMARK_HPP
@@ -0,0 +1,138 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "benchmark.hpp"
+
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QVector>
+
+#include <TelegramQt/TelegramNamespace>
+
+static const int c_eventCount = 100000;
+
+class EventSource : public QObject
+{
+    Q_OBJECT
+signals:
+    void messageActionChanged(const Telegram::Peer &peer, quint32 userId);
+};
+
+// Holds only what the dispatch touches: the target peer and the delivered events
+class ChannelStub : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ChannelStub(const Telegram::Peer &peer) : m_targetPeer(peer) { }
+
+    void setMessageAction(quint32 userId) { m_actions += userId; }
+    quint64 actions() const { return m_actions; }
+
+public slots:
+    // The former pattern: every channel is connected to the global signal and filters it
+    void onMessageActionChanged(const Telegram::Peer &peer, quint32 userId)
+    {
+        if (peer != m_targetPeer) {
+            return;
+        }
+        setMessageAction(userId);
+    }
+
+protected:
+    Telegram::Peer m_targetPeer;
+    quint64 m_actions = 0;
+};
+
+class ChannelDispatcher : public QObject
+{
+    Q_OBJECT
+public:
+    QHash<Telegram::Peer, QPointer<ChannelStub>> channels;
+
+public slots:
+    // The current pattern: one connection, routed by the peer -> channel table
+    void onMessageActionChanged(const Telegram::Peer &peer, quint32 userId)
+    {
+        if (ChannelStub *channel = channels.value(peer).data()) {
+            channel->setMessageAction(userId);
+        }
+    }
+};
+
+static void benchmarkDispatch(int channelCount)
+{
+    QVector<Telegram::Peer> peers;
+    QVector<ChannelStub *> channels;
+    for (int i = 0; i < channelCount; ++i) {
+        peers.append(Telegram::Peer::fromUserId(quint32(100000000 + i)));
+        channels.append(new ChannelStub(peers.last()));
+    }
+
+    EventSource broadcastSource;
+    for (ChannelStub *channel : channels) {
+        QObject::connect(&broadcastSource, &EventSource::messageActionChanged,
+                         channel, &ChannelStub::onMessageActionChanged);
+    }
+
+    EventSource routedSource;
+    ChannelDispatcher dispatcher;
+    for (int i = 0; i < channelCount; ++i) {
+        dispatcher.channels.insert(peers.at(i), channels.at(i));
+    }
+    QObject::connect(&routedSource, &EventSource::messageActionChanged,
+                     &dispatcher, &ChannelDispatcher::onMessageActionChanged);
+
+    const QString suffix = QLatin1String(" (") + QString::number(channelCount) + QLatin1String(" channels)");
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < c_eventCount; ++i) {
+        emit broadcastSource.messageActionChanged(peers.at(i % channelCount), quint32(i));
+    }
+    MorseBenchmark::reportTime(QLatin1String("broadcast event") + suffix, timer, c_eventCount);
+
+    timer.start();
+    for (int i = 0; i < c_eventCount; ++i) {
+        emit routedSource.messageActionChanged(peers.at(i % channelCount), quint32(i));
+    }
+    MorseBenchmark::reportTime(QLatin1String("routed event") + suffix, timer, c_eventCount);
+
+    quint64 sum = 0;
+    for (ChannelStub *channel : channels) {
+        sum += channel->actions();
+    }
+    MorseBenchmark::consume(sum);
+    qDeleteAll(channels);
+}
+
+/*
+ * A model of the two ways to deliver a chat event (e.g. typing) to the channel of its peer.
+ *
+ * The stubs stand in for MorseTextChannel and MorseConnection, so the results compare
+ * the broadcast and the routing patterns, not the cost of the real channels.
+ */
+void benchmarkChannelDispatch()
+{
+    for (int channelCount : { 1, 10, 100, 1000 }) {
+        benchmarkDispatch(channelCount);
+    }
+}
+
+#include "channeldispatchbenchmark.moc"
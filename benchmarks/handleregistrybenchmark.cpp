@@ -0,0 +1,100 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "benchmark.hpp"
+#include "handleregistry.hpp"
+
+#include <QMap>
+#include <QVector>
+
+static const int c_peerCount = 100000;
+static const int c_rounds = 10;
+
+/*
+ * Handle lookups on a 100k-peer account: the registry against the QMap tables
+ * (handle -> peer, and the peer -> handle search) it replaced.
+ */
+void benchmarkHandleRegistry()
+{
+    QVector<Telegram::Peer> peers;
+    peers.reserve(c_peerCount);
+    for (int i = 0; i < c_peerCount; ++i) {
+        // Spread the ids like the real user ids
+        peers.append(Telegram::Peer::fromUserId(quint32(100000000 + i * 7919)));
+    }
+
+    MorseHandleRegistry registry;
+    QElapsedTimer timer;
+    timer.start();
+    for (const Telegram::Peer &peer : peers) {
+        registry.ensureHandle(peer);
+    }
+    MorseBenchmark::reportTime(QStringLiteral("registry ensureHandle"), timer, c_peerCount);
+
+    quint64 sum = 0;
+    timer.start();
+    for (int round = 0; round < c_rounds; ++round) {
+        for (const Telegram::Peer &peer : peers) {
+            sum += registry.handle(peer);
+        }
+    }
+    MorseBenchmark::reportTime(QStringLiteral("registry peer -> handle"), timer, qint64(c_peerCount) * c_rounds);
+
+    timer.start();
+    for (int round = 0; round < c_rounds; ++round) {
+        for (uint handle = 1; handle <= registry.lastHandle(); ++handle) {
+            sum += registry.peer(handle).id();
+        }
+    }
+    MorseBenchmark::reportTime(QStringLiteral("registry handle -> peer"), timer, qint64(c_peerCount) * c_rounds);
+
+    timer.start();
+    const QStringList serialized = registry.toStringList();
+    MorseBenchmark::reportTime(QStringLiteral("registry toStringList"), timer, c_peerCount);
+    timer.start();
+    MorseHandleRegistry loaded;
+    loaded.fromStringList(serialized);
+    MorseBenchmark::reportTime(QStringLiteral("registry fromStringList"), timer, c_peerCount);
+
+    // The baseline: handle -> peer map with a linear search for the reverse direction
+    QMap<uint, Telegram::Peer> map;
+    timer.start();
+    for (int i = 0; i < c_peerCount; ++i) {
+        map.insert(uint(i + 1), peers.at(i));
+    }
+    MorseBenchmark::reportTime(QStringLiteral("QMap insert"), timer, c_peerCount);
+
+    timer.start();
+    for (int round = 0; round < c_rounds; ++round) {
+        for (uint handle = 1; handle <= uint(c_peerCount); ++handle) {
+            sum += map.value(handle).id();
+        }
+    }
+    MorseBenchmark::reportTime(QStringLiteral("QMap handle -> peer"), timer, qint64(c_peerCount) * c_rounds);
+
+    // The reverse search is linear, so sample a few peers only
+    const int sampleCount = 100;
+    timer.start();
+    for (int i = 0; i < sampleCount; ++i) {
+        sum += map.key(peers.at(i * (c_peerCount / sampleCount)));
+    }
+    MorseBenchmark::reportTime(QStringLiteral("QMap peer -> handle"), timer, sampleCount);
+
+    MorseBenchmark::consume(sum);
+}
@@ -0,0 +1,83 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "benchmark.hpp"
+
+#include <QCoreApplication>
+#include <QStringList>
+
+#include <cstdio>
+
+static volatile quint64 s_sink = 0;
+
+namespace MorseBenchmark {
+
+void reportTime(const QString &name, const QElapsedTimer &timer, qint64 operations)
+{
+    const qint64 nanoseconds = timer.nsecsElapsed();
+    printf("%s: %.1f ns/op (%lld ops, %.3f ms)\n", qPrintable(name),
+           double(nanoseconds) / qMax<qint64>(1, operations), static_cast<long long>(operations),
+           double(nanoseconds) / 1000000);
+}
+
+void reportValue(const QString &name, qint64 value, const char *unit)
+{
+    printf("%s: %lld %s\n", qPrintable(name), static_cast<long long>(value), unit);
+}
+
+void consume(quint64 value)
+{
+    s_sink = s_sink + value;
+}
+
+} // MorseBenchmark namespace
+
+struct BenchmarkEntry
+{
+    const char *name;
+    void (*run)();
+};
+
+static const BenchmarkEntry c_benchmarks[] = {
+    { "handles", benchmarkHandleRegistry },
+    { "channels", benchmarkChannelDispatch },
+    { "state", benchmarkStateJournal },
+};
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    // Run the benchmarks given by name, or all of them
+    QStringList names = app.arguments().mid(1);
+    for (const BenchmarkEntry &benchmark : c_benchmarks) {
+        if (!names.isEmpty() && !names.removeOne(QLatin1String(benchmark.name))) {
+            continue;
+        }
+        printf("# %s\n", benchmark.name);
+        fflush(stdout);
+        benchmark.run();
+    }
+
+    if (!names.isEmpty()) {
+        fprintf(stderr, "Unknown benchmarks: %s\n", qPrintable(names.join(QLatin1String(", "))));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,139 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "benchmark.hpp"
+#include "statejournal.hpp"
+
+#include <QDataStream>
+#include <QStringList>
+#include <QTemporaryDir>
+
+#include <random>
+
+static const int c_userCount = 20000;
+static const int c_messageCount = 200000;
+static const int c_newMessageCount = 100; // Per incremental save
+
+static QString randomWord(std::mt19937 *random)
+{
+    static const char c_letters[] = "etaoinshrdlucmfwypvbgkjqxz";
+    std::uniform_int_distribution<int> length(2, 10);
+    // Skewed towards the frequent letters to compress like a real text
+    std::geometric_distribution<int> letter(0.15);
+    QString word;
+    const int count = length(*random);
+    for (int i = 0; i < count; ++i) {
+        word.append(QLatin1Char(c_letters[qMin(letter(*random), 25)]));
+    }
+    return word;
+}
+
+static void appendMessages(QDataStream *stream, std::mt19937 *random, int first, int count)
+{
+    std::uniform_int_distribution<int> words(1, 30);
+    std::uniform_int_distribution<quint32> user(1, c_userCount);
+    for (int i = first; i < first + count; ++i) {
+        QStringList text;
+        const int wordCount = words(*random);
+        for (int j = 0; j < wordCount; ++j) {
+            text.append(randomWord(random));
+        }
+        *stream << quint32(i) << user(*random) << quint32(1500000000 + i * 60) << text.join(QLatin1Char(' '));
+    }
+}
+
+/*
+ * A state blob shaped like the TelegramQt data storage of a large account:
+ * the users first, then the message history.
+ */
+static QByteArray makeState(int messageCount)
+{
+    std::mt19937 random(42);
+    QByteArray state;
+    QDataStream stream(&state, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    stream << quint32(c_userCount);
+    for (int i = 1; i <= c_userCount; ++i) {
+        stream << quint32(i) << quint64(random()) << randomWord(&random) << randomWord(&random)
+               << randomWord(&random) << QString::number(79000000000ll + i);
+    }
+    stream << quint32(messageCount);
+    appendMessages(&stream, &random, 0, messageCount);
+    return state;
+}
+
+static void benchmarkCodec(const QByteArray &state, const QByteArray &updatedState,
+                           MorseStateJournal::Codec codec, const QString &codecName)
+{
+    QTemporaryDir directory;
+    const QString snapshotFileName = directory.path() + QLatin1String("/telegram-state.bin");
+    const QString journalFileName = directory.path() + QLatin1String("/telegram-state.journal");
+
+    MorseStateJournal journal;
+    journal.setSnapshotFileName(snapshotFileName);
+    journal.setJournalFileName(journalFileName);
+    journal.setCompression(codec);
+
+    QElapsedTimer timer;
+    timer.start();
+    journal.save(state);
+    MorseBenchmark::reportTime(codecName + QLatin1String(" snapshot save"), timer, 1);
+    MorseBenchmark::reportValue(codecName + QLatin1String(" snapshot size"), journal.storedSnapshotSize(), "bytes");
+
+    timer.start();
+    journal.save(updatedState);
+    MorseBenchmark::reportTime(codecName + QLatin1String(" incremental save"), timer, 1);
+    MorseBenchmark::reportValue(codecName + QLatin1String(" journal size"), journal.journalSize(), "bytes");
+
+    MorseStateJournal loader;
+    loader.setSnapshotFileName(snapshotFileName);
+    loader.setJournalFileName(journalFileName);
+    timer.start();
+    const bool opened = loader.open();
+    MorseBenchmark::reportTime(codecName + QLatin1String(" open"), timer, 1);
+
+    QByteArray loadedState;
+    timer.start();
+    const bool loaded = opened && loader.load(&loadedState);
+    MorseBenchmark::reportTime(codecName + QLatin1String(" load"), timer, 1);
+    if (!loaded || (loadedState != updatedState)) {
+        MorseBenchmark::reportValue(codecName + QLatin1String(" load FAILED"), loadedState.size(), "bytes");
+    }
+}
+
+/*
+ * Size, save and load time of the state storage on a synthetic large account.
+ */
+void benchmarkStateJournal()
+{
+    const QByteArray state = makeState(c_messageCount);
+    QByteArray updatedState = state;
+    {
+        // A few new messages since the last save
+        std::mt19937 random(7);
+        QDataStream stream(&updatedState, QIODevice::WriteOnly|QIODevice::Append);
+        stream.setVersion(QDataStream::Qt_5_6);
+        appendMessages(&stream, &random, c_messageCount, c_newMessageCount);
+    }
+    MorseBenchmark::reportValue(QStringLiteral("state size"), state.size(), "bytes");
+
+    benchmarkCodec(state, updatedState, MorseStateJournal::CodecNone, QStringLiteral("none"));
+    benchmarkCodec(state, updatedState, MorseStateJournal::CodecZlib, QStringLiteral("zlib"));
+}
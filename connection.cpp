@@ -19,10 +19,19 @@
 
 #include "connection.hpp"
 
+#include "avatarcache.hpp"
+#include "avatarscheduler.hpp"
+#include "avatartranscoder.hpp"
 #include "datastorage.hpp"
 #include "info.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
+#include "metricsinterface.hpp"
 #include "protocol.hpp"
+#include "reconnectcontroller.hpp"
+#include "syncscheduler.hpp"
 #include "textchannel.hpp"
+#include "watchdog.hpp"
 
 #if TP_QT_VERSION < TP_QT_VERSION_CHECK(0, 9, 8)
 #include "contactgroups.hpp"
@@ -48,13 +57,18 @@
 #include <TelepathyQt/BaseChannel>
 
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QTimer>
 
 #include <QStandardPaths>
 
+#include <climits>
+
 #define DIALOGS_AS_CONTACTLIST
 //#define BROADCAST_AS_CONTACT
 
 static constexpr int c_selfHandle = 1;
+static constexpr int c_backlogTimeSlice = 10; // ms of the main loop time per backlog delivery step
 static const QString c_onlineSimpleStatusKey = QLatin1String("available");
 static const QString c_saslMechanismTelepathyPassword = QLatin1String("X-TELEPATHY-PASSWORD");
 
@@ -62,7 +76,8 @@ using namespace Telegram;
 
 Tp::AvatarSpec MorseConnection::avatarDetails()
 {
-    static const auto spec = Tp::AvatarSpec(/* supportedMimeTypes */ QStringList() << QLatin1String("image/jpeg"),
+    static const auto spec = Tp::AvatarSpec(/* supportedMimeTypes */ QStringList() << QLatin1String("image/jpeg")
+                                                                                    << QLatin1String("image/png"),
                                             /* minHeight */ 0, /* maxHeight */ 160, /* recommendedHeight */ 160,
                                             /* minWidth */ 0, /* maxWidth */ 160, /* recommendedWidth */ 160,
                                             /* maxBytes */ 10240);
@@ -149,9 +164,10 @@ Tp::RequestableChannelClassSpecList MorseConnection::getRequestableChannelList()
 }
 
 MorseConnection::MorseConnection(const QDBusConnection &dbusConnection, const QString &cmName, const QString &protocolName, const QVariantMap &parameters) :
-    Tp::BaseConnection(dbusConnection, cmName, protocolName, parameters)
+    Tp::BaseConnection(dbusConnection, cmName, protocolName, parameters),
+    m_metrics(new MorseMetrics())
 {
-    qDebug() << Q_FUNC_INFO;
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO;
     m_selfPhone = MorseProtocol::getAccount(parameters);
     m_serverAddress = MorseProtocol::getServerAddress(parameters);
     m_serverPort = MorseProtocol::getServerPort(parameters);
@@ -227,6 +243,9 @@ MorseConnection::MorseConnection(const QDBusConnection &dbusConnection, const QS
     plugInterface(Tp::AbstractConnectionInterfacePtr::dynamicCast(groupsIface));
 #endif
 
+    MorseMetricsInterfacePtr metricsIface = MorseMetricsInterface::create(m_metrics, &m_messageTracer);
+    plugInterface(Tp::AbstractConnectionInterfacePtr::dynamicCast(metricsIface));
+
     /* Connection.Interface.Requests */
     requestsIface = Tp::BaseConnectionRequestsInterface::create(this);
     requestsIface->requestableChannelClasses = getRequestableChannelList().bareClasses();
@@ -241,7 +260,7 @@ MorseConnection::MorseConnection(const QDBusConnection &dbusConnection, const QS
 
     connect(this, &BaseConnection::disconnected, this, &MorseConnection::onDisconnected);
 
-    m_contactHandles.insert(c_selfHandle, Telegram::Peer());
+    m_contactHandles.setPeer(c_selfHandle, Telegram::Peer());
     setSelfHandle(c_selfHandle);
 
     m_appInfo = new Client::AppInformation(this);
@@ -262,11 +281,11 @@ MorseConnection::MorseConnection(const QDBusConnection &dbusConnection, const QS
 
     if (!m_serverAddress.isEmpty()) {
         if ((m_serverPort == 0) || (m_serverKeyFile.isEmpty())) {
-            qCritical() << "Invalid server configuration!";
+            qCCritical(lcMorseConnection) << "Invalid server configuration!";
         }
         RsaKey key = RsaKey::fromFile(m_serverKeyFile);
         if (!key.isValid()) {
-            qCritical() << "Unable to read server key!";
+            qCCritical(lcMorseConnection) << "Unable to read server key!";
         }
         DcOption customServer;
         customServer.address = m_serverAddress;
@@ -281,18 +300,54 @@ MorseConnection::MorseConnection(const QDBusConnection &dbusConnection, const QS
     accountStorage->setPhoneNumber(m_selfPhone);
     accountStorage->setAccountIdentifier(m_info->accountIdentifier());
     accountStorage->setFileName(m_info->accountDataFilePath());
-    qDebug() << "Account data file:" << accountStorage->fileName();
+    qCDebug(lcMorseConnection) << "Account data file:" << accountStorage->fileName();
     connect(accountStorage, &Client::FileAccountStorage::accountInvalidated, this, &MorseConnection::onAccountInvalidated);
     m_client->setAccountStorage(accountStorage);
 
     m_dataStorage = new MorseDataStorage(m_client);
     m_dataStorage->setInfo(m_info);
+    m_dataStorage->setHandleRegistries(&m_contactHandles, &m_chatHandles);
+    m_dataStorage->setMetrics(m_metrics);
+    m_dataStorage->setJournalEnabled(MorseProtocol::getStateJournalEnabled(parameters));
+    if (!m_dataStorage->setCompression(MorseProtocol::getStateCompression(parameters),
+                                       MorseProtocol::getStateCompressionLevel(parameters))) {
+        qCWarning(lcMorseConnection) << "Unknown state compression" << MorseProtocol::getStateCompression(parameters) << ", ignored.";
+    }
     m_client->setDataStorage(m_dataStorage);
 
+    m_avatarCache = new MorseAvatarCache(this);
+    if (!m_info->accountDataDirectory().isEmpty()) {
+        m_avatarCache->setDirectory(m_info->accountDataDirectory() + QLatin1String("/avatars"));
+    }
+    connect(m_avatarCache, &MorseAvatarCache::avatarLoaded,
+            this, &MorseConnection::onAvatarLoaded);
+    connect(m_avatarCache, &MorseAvatarCache::avatarMissing,
+            this, &MorseConnection::onAvatarMissing);
+    m_avatarScheduler = new MorseAvatarScheduler(m_client, this);
+    connect(m_avatarScheduler, &MorseAvatarScheduler::avatarDownloaded,
+            this, &MorseConnection::onAvatarDownloaded);
+    m_avatarTranscoder = new MorseAvatarTranscoder(this);
+    m_avatarTranscoder->setLimits(avatarDetails().maximumWidth(), avatarDetails().maximumHeight(),
+                                  avatarDetails().maximumBytes());
+    m_avatarTranscoder->setMimeTypes(avatarDetails().supportedMimeTypes());
+    connect(m_avatarTranscoder, &MorseAvatarTranscoder::avatarReady,
+            this, &MorseConnection::onAvatarTranscoded);
+
     clientSettings->setPingInterval(m_keepAliveInterval * 1000);
     m_client->setAppInformation(m_appInfo);
     m_client->messagingApi()->setSyncMode(Client::MessagingApi::ManualSync);
-    m_client->messagingApi()->setSyncLimit(30);
+
+    m_syncScheduler = new MorseSyncScheduler(m_client->messagingApi(), this);
+    m_syncScheduler->setSyncLimit(MorseProtocol::getSyncLimit(parameters));
+    m_syncScheduler->setMaxSyncLimit(MorseProtocol::getSyncMaxLimit(parameters));
+    m_syncScheduler->setImmediateCount(MorseProtocol::getSyncImmediateDialogs(parameters));
+    m_syncScheduler->setConcurrency(MorseProtocol::getSyncConcurrency(parameters));
+
+    m_reconnectController = new MorseReconnectController(this);
+    connect(m_reconnectController, &MorseReconnectController::reconnectRequested,
+            this, &MorseConnection::onReconnectRequested);
+    connect(m_reconnectController, &MorseReconnectController::networkChanged,
+            this, &MorseConnection::onNetworkChanged);
 
     connect(m_client->connectionApi(), &Telegram::Client::ConnectionApi::statusChanged,
             this, &MorseConnection::onConnectionStatusChanged);
@@ -302,6 +357,14 @@ MorseConnection::MorseConnection(const QDBusConnection &dbusConnection, const QS
              this, &MorseConnection::onNewMessageReceived);
     connect(m_client->messagingApi(), &Telegram::Client::MessagingApi::syncMessages,
              this, &MorseConnection::onSyncMessagesReceived);
+    connect(m_client->messagingApi(), &Telegram::Client::MessagingApi::messageActionChanged,
+             this, &MorseConnection::onMessageActionChanged);
+    connect(m_client->messagingApi(), &Telegram::Client::MessagingApi::messageReadInbox,
+             this, &MorseConnection::onMessageReadInbox);
+    connect(m_client->messagingApi(), &Telegram::Client::MessagingApi::messageReadOutbox,
+             this, &MorseConnection::onMessageReadOutbox);
+    connect(this, &MorseConnection::chatDetailsChanged,
+            this, &MorseConnection::onChatDetailsChanged);
 //    connect(m_core, &CTelegramCore::chatChanged,
 //            this, &MorseConnection::whenChatChanged);
     connect(m_client->contactsApi(), &Telegram::Client::ContactsApi::contactStatusChanged,
@@ -315,9 +378,9 @@ MorseConnection::MorseConnection(const QDBusConnection &dbusConnection, const QS
             const QString proxyUsername = MorseProtocol::getProxyUsername(parameters);
             const QString proxyPassword = MorseProtocol::getProxyPassword(parameters);
             if (proxyServer.isEmpty() || proxyPort == 0) {
-                qWarning() << "Invalid proxy configuration, ignored";
+                qCWarning(lcMorseConnection) << "Invalid proxy configuration, ignored";
             } else {
-                qDebug() << Q_FUNC_INFO << "Set proxy";
+                qCDebug(lcMorseConnection) << Q_FUNC_INFO << "Set proxy";
                 QNetworkProxy proxy;
                 proxy.setType(QNetworkProxy::Socks5Proxy);
                 proxy.setHostName(proxyServer);
@@ -327,7 +390,7 @@ MorseConnection::MorseConnection(const QDBusConnection &dbusConnection, const QS
                 clientSettings->setProxy(proxy);
             }
         } else {
-            qWarning() << "Unknown proxy type" << proxyType << ", ignored.";
+            qCWarning(lcMorseConnection) << "Unknown proxy type" << proxyType << ", ignored.";
         }
     }
 
@@ -336,11 +399,15 @@ MorseConnection::MorseConnection(const QDBusConnection &dbusConnection, const QS
 
 void MorseConnection::doConnect(Tp::DBusError *error)
 {
+    MORSE_WATCHDOG_SCOPE();
     Q_UNUSED(error);
 
     m_authReconnectionsCount = 0;
     setStatus(Tp::ConnectionStatusConnecting, Tp::ConnectionStatusReasonRequested);
 
+    m_dataStorage->ensureStateLoaded();
+    publishCachedContactList();
+
     if (m_client->accountStorage()->loadData() && m_client->accountStorage()->hasMinimalDataSet()) {
         Telegram::Client::AuthOperation *checkInOperation = m_client->connectionApi()->checkIn();
         checkInOperation->connectToFinished(this, &MorseConnection::onCheckInFinished, checkInOperation);
@@ -378,24 +445,38 @@ void MorseConnection::signInOrUp()
 void MorseConnection::onConnectionStatusChanged(Client::ConnectionApi::Status status,
                                                 Client::ConnectionApi::StatusReason reason)
 {
-    qDebug() << Q_FUNC_INFO << status << reason;
+    MORSE_WATCHDOG_SCOPE();
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO << status << reason;
     switch (status) {
     case Client::ConnectionApi::StatusConnected:
         onAuthenticated();
         break;
     case Client::ConnectionApi::StatusReady:
+        m_reconnectController->connectionRestored();
         onConnectionReady();
         updateSelfContactState(Tp::ConnectionStatusConnected);
         break;
     case Client::ConnectionApi::StatusDisconnected:
-        if (reason == Client::ConnectionApi::StatusReasonLocal) {
+        if ((reason == Client::ConnectionApi::StatusReasonLocal) && !m_networkReset) {
             // Requested from adaptee, no signal needed.
+            m_reconnectController->stop();
+            m_avatarScheduler->clear();
+            clearBacklog();
+            m_syncScheduler->clear();
             setStatus(Tp::ConnectionStatusDisconnected, Tp::ConnectionStatusReasonRequested);
         } else {
-            // There is not other reason to disconnect, is there?
-            // setStatus(Tp::ConnectionStatusDisconnected, Tp::ConnectionStatusReasonNetworkError);
-            // updateSelfContactState(Tp::ConnectionStatusDisconnected);
-            // emit disconnected();
+            m_networkReset = false;
+            if (!m_reconnectController->isActive()) {
+                // Persist the latest update state to resume from it after the reconnection.
+                // The failed attempts of the backoff do not change the state, so save only once.
+                m_dataStorage->saveData();
+            }
+            // A Telepathy connection can not go back to Connecting once it is Connected,
+            // so the connection stays Connected while the self presence reports the loss.
+            if (BaseConnection::status() == Tp::ConnectionStatusConnected) {
+                updateSelfContactState(Tp::ConnectionStatusDisconnected);
+            }
+            m_reconnectController->connectionLost();
         }
         break;
     default:
@@ -405,7 +486,7 @@ void MorseConnection::onConnectionStatusChanged(Client::ConnectionApi::Status st
 
 void MorseConnection::onAuthenticated()
 {
-    qDebug() << Q_FUNC_INFO;
+    qCDebug(lcMorseAuth) << Q_FUNC_INFO;
 
     if (!saslIface_authCode.isNull()) {
         saslIface_authCode->setSaslStatus(Tp::SASLStatusSucceeded, QLatin1String("Succeeded"), QVariantMap());
@@ -415,26 +496,30 @@ void MorseConnection::onAuthenticated()
         saslIface_password->setSaslStatus(Tp::SASLStatusSucceeded, QLatin1String("Succeeded"), QVariantMap());
     }
 
-    contactListIface->setContactListState(Tp::ContactListStateWaiting);
+    if (contactListIface->contactListState() != Tp::ContactListStateSuccess) {
+        // Keep the cached roster (if any) published while the dialogs are being fetched
+        contactListIface->setContactListState(Tp::ContactListStateWaiting);
+    }
 }
 
 void MorseConnection::onSelfUserAvailable()
 {
-    qDebug() << Q_FUNC_INFO;
+    qCDebug(lcMorseAuth) << Q_FUNC_INFO;
 
     const Telegram::Peer selfIdentifier = Telegram::Peer::fromUserId(m_client->contactsApi()->selfUserId());
     if (!selfIdentifier.isValid()) {
-        qCritical() << Q_FUNC_INFO << "Self id unexpectedly not available";
+        qCCritical(lcMorseAuth) << Q_FUNC_INFO << "Self id unexpectedly not available";
         return;
     }
 
-    m_contactHandles.insert(c_selfHandle, selfIdentifier);
+    m_contactHandles.setPeer(c_selfHandle, selfIdentifier);
+    invalidateContactAttributes(c_selfHandle);
     setSelfContact(c_selfHandle, selfIdentifier.toString());
 }
 
 void MorseConnection::onAuthCodeRequired()
 {
-    qDebug() << Q_FUNC_INFO;
+    qCDebug(lcMorseAuth) << Q_FUNC_INFO;
 
     Tp::DBusError error;
 
@@ -461,7 +546,7 @@ void MorseConnection::onAuthCodeRequired()
     baseChannel->registerObject(&error);
 
     if (error.isValid()) {
-        qDebug() << Q_FUNC_INFO << error.name() << error.message();
+        qCDebug(lcMorseAuth) << Q_FUNC_INFO << error.name() << error.message();
     } else {
         addChannel(baseChannel);
     }
@@ -489,7 +574,7 @@ void MorseConnection::onAuthErrorOccurred(Namespace::AuthenticationError errorCo
 
 void MorseConnection::onPasswordRequired()
 {
-    qDebug() << Q_FUNC_INFO;
+    qCDebug(lcMorseAuth) << Q_FUNC_INFO;
     Tp::BaseChannelPtr baseChannel = Tp::BaseChannel::create(this, TP_QT_IFACE_CHANNEL_TYPE_SERVER_AUTHENTICATION);
     Tp::BaseChannelServerAuthenticationTypePtr authType
             = Tp::BaseChannelServerAuthenticationType::create(TP_QT_IFACE_CHANNEL_INTERFACE_SASL_AUTHENTICATION);
@@ -513,7 +598,7 @@ void MorseConnection::onPasswordRequired()
     baseChannel->registerObject(&error);
 
     if (error.isValid()) {
-        qDebug() << Q_FUNC_INFO << error.name() << error.message();
+        qCDebug(lcMorseAuth) << Q_FUNC_INFO << error.name() << error.message();
     } else {
         addChannel(baseChannel);
     }
@@ -531,20 +616,91 @@ void MorseConnection::onPasswordCheckFailed()
 
 void MorseConnection::onSignInFinished()
 {
-    qDebug() << Q_FUNC_INFO << m_signOperation->errorDetails();
+    qCDebug(lcMorseAuth) << Q_FUNC_INFO << m_signOperation->errorDetails();
 }
 
 void MorseConnection::onCheckInFinished(Client::AuthOperation *checkInOperation)
 {
-    qDebug() << Q_FUNC_INFO << checkInOperation->errorDetails();
+    qCDebug(lcMorseAuth) << Q_FUNC_INFO << checkInOperation->errorDetails();
     if (!checkInOperation->isSucceeded()) {
         tryToStartAuthentication();
     }
 }
 
+static bool isAuthorizationError(const QVariantHash &details)
+{
+    // RPC errors (401 UNAUTHORIZED) which mean that the session is gone and a retry can not help
+    static const QSet<QString> authorizationErrors = {
+        QStringLiteral("AUTH_KEY_UNREGISTERED"),
+        QStringLiteral("AUTH_KEY_INVALID"),
+        QStringLiteral("AUTH_KEY_PERM_EMPTY"),
+        QStringLiteral("SESSION_REVOKED"),
+        QStringLiteral("SESSION_EXPIRED"),
+        QStringLiteral("USER_DEACTIVATED"),
+    };
+    // The failed RPC operation reports the error type (the RPC error message) as the text
+    return authorizationErrors.contains(details.value(PendingOperation::c_text()).toString());
+}
+
+void MorseConnection::onReconnectCheckInFinished(Client::AuthOperation *checkInOperation)
+{
+    if (checkInOperation->isSucceeded()) {
+        return;
+    }
+    const QVariantHash details = checkInOperation->errorDetails();
+    if (!isAuthorizationError(details) && m_client->accountStorage()->hasMinimalDataSet()) {
+        // A network failure; the next attempt is already scheduled by the reconnect controller
+        qCDebug(lcMorseConnection) << Q_FUNC_INFO << details;
+        return;
+    }
+
+    // The session is revoked or invalidated: do not retry, the account needs a new sign in
+    qCWarning(lcMorseAuth) << Q_FUNC_INFO << "The session is rejected:" << details;
+    m_reconnectController->stop();
+    m_avatarScheduler->clear();
+    clearBacklog();
+    m_syncScheduler->clear();
+    setStatus(Tp::ConnectionStatusDisconnected, Tp::ConnectionStatusReasonAuthenticationFailed);
+}
+
+void MorseConnection::onReconnectRequested()
+{
+    MORSE_WATCHDOG_SCOPE();
+    if (status() == Tp::ConnectionStatusDisconnected) {
+        m_reconnectController->stop();
+        return;
+    }
+    if (m_client->connectionApi()->status() != Client::ConnectionApi::StatusDisconnected) {
+        qCDebug(lcMorseConnection) << Q_FUNC_INFO << "The previous attempt is still in progress";
+        return;
+    }
+    if (!m_client->accountStorage()->hasMinimalDataSet()) {
+        // Lost in the middle of the authentication; there is no session to resume
+        qCWarning(lcMorseConnection) << Q_FUNC_INFO << "No session to resume";
+        m_reconnectController->stop();
+        setStatus(Tp::ConnectionStatusDisconnected, Tp::ConnectionStatusReasonNetworkError);
+        return;
+    }
+
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO << "attempt" << m_reconnectController->attempt();
+    Telegram::Client::AuthOperation *checkInOperation = m_client->connectionApi()->checkIn();
+    checkInOperation->connectToFinished(this, &MorseConnection::onReconnectCheckInFinished, checkInOperation);
+}
+
+void MorseConnection::onNetworkChanged()
+{
+    if (m_client->connectionApi()->status() == Client::ConnectionApi::StatusDisconnected) {
+        return;
+    }
+    // Do not wait for the ping timeout: the socket bound to the previous network is dead
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO << "Drop the connection to reconnect via the new network";
+    m_networkReset = true;
+    m_client->connectionApi()->disconnectFromServer();
+}
+
 void MorseConnection::onAccountInvalidated(const QString &accountIdentifier)
 {
-    qWarning() << Q_FUNC_INFO << accountIdentifier;
+    qCWarning(lcMorseAuth) << Q_FUNC_INFO << accountIdentifier;
     if (accountIdentifier == m_info->accountIdentifier()) {
         m_client->accountStorage()->sync();
     }
@@ -552,7 +708,7 @@ void MorseConnection::onAccountInvalidated(const QString &accountIdentifier)
 
 void MorseConnection::startMechanismWithData_authCode(const QString &mechanism, const QByteArray &data, Tp::DBusError *error)
 {
-    qDebug() << Q_FUNC_INFO << mechanism << data;
+    qCDebug(lcMorseAuth) << Q_FUNC_INFO << mechanism << data;
     if (!saslIface_authCode->availableMechanisms().contains(mechanism)) {
         error->set(TP_QT_ERROR_NOT_IMPLEMENTED, QString(QLatin1String("Given SASL mechanism \"%1\" is not implemented")).arg(mechanism));
         return;
@@ -564,7 +720,7 @@ void MorseConnection::startMechanismWithData_authCode(const QString &mechanism,
 
 void MorseConnection::startMechanismWithData_password(const QString &mechanism, const QByteArray &data, Tp::DBusError *error)
 {
-    qDebug() << Q_FUNC_INFO << mechanism << data;
+    qCDebug(lcMorseAuth) << Q_FUNC_INFO << mechanism << data;
     if (!saslIface_password->availableMechanisms().contains(mechanism)) {
         error->set(TP_QT_ERROR_NOT_IMPLEMENTED, QStringLiteral("Given SASL mechanism \"%1\" is not implemented").arg(mechanism));
         return;
@@ -576,12 +732,18 @@ void MorseConnection::startMechanismWithData_password(const QString &mechanism,
 
 void MorseConnection::onConnectionReady()
 {
-    qDebug() << Q_FUNC_INFO;
+    MORSE_WATCHDOG_SCOPE();
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO;
     //m_core->setOnlineStatus(m_wantedPresence == c_onlineSimpleStatusKey);
     //m_core->setMessageReceivingFilter(TelegramNamespace::MessageFlagNone);
 
 #ifdef DIALOGS_AS_CONTACTLIST
-    if (m_dialogs) {
+    if (m_dialogs && m_dialogsSynced) {
+        // Reconnection: TelegramQt fetches the missed updates starting from the update state
+        // (pts/date/seq) kept in the data storage, so neither the dialogs nor the history
+        // are reloaded. Only reconcile the roster with the updated dialogs.
+        updateContactList();
+    } else if (m_dialogs) {
         onDialogsReady();
     } else {
         m_dialogs = m_client->messagingApi()->getDialogList();
@@ -603,7 +765,8 @@ void MorseConnection::onConnectionReady()
 
 QStringList MorseConnection::inspectHandles(uint handleType, const Tp::UIntList &handles, Tp::DBusError *error)
 {
-    qDebug() << Q_FUNC_INFO << handleType << handles;
+    MORSE_WATCHDOG_SCOPE();
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO << handleType << handles;
 
     switch (handleType) {
     case Tp::HandleTypeContact:
@@ -618,7 +781,7 @@ QStringList MorseConnection::inspectHandles(uint handleType, const Tp::UIntList
 
     QStringList result;
 
-    const QMap<uint, Telegram::Peer> handlesContainer = handleType == Tp::HandleTypeContact ? m_contactHandles : m_chatHandles;
+    const MorseHandleRegistry &handlesContainer = handleType == Tp::HandleTypeContact ? m_contactHandles : m_chatHandles;
 
     foreach (uint handle, handles) {
         if (!handlesContainer.contains(handle)) {
@@ -628,7 +791,7 @@ QStringList MorseConnection::inspectHandles(uint handleType, const Tp::UIntList
             return QStringList();
         }
 
-        result.append(handlesContainer.value(handle).toString());
+        result.append(handlesContainer.peer(handle).toString());
     }
 
     return result;
@@ -636,6 +799,7 @@ QStringList MorseConnection::inspectHandles(uint handleType, const Tp::UIntList
 
 Tp::BaseChannelPtr MorseConnection::createChannelCB(const QVariantMap &request, Tp::DBusError *error)
 {
+    MORSE_WATCHDOG_SCOPE();
     const QString channelType = request.value(TP_QT_IFACE_CHANNEL + QLatin1String(".ChannelType")).toString();
 
     if (channelType == TP_QT_IFACE_CHANNEL_TYPE_ROOM_LIST) {
@@ -650,7 +814,7 @@ Tp::BaseChannelPtr MorseConnection::createChannelCB(const QVariantMap &request,
     case Tp::HandleTypeContact:
         if (request.contains(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandle"))) {
             targetHandle = request.value(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandle")).toUInt();
-            targetID = m_contactHandles.value(targetHandle);
+            targetID = m_contactHandles.peer(targetHandle);
         } else if (request.contains(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetID"))) {
             targetID = Telegram::Peer::fromString(request.value(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetID")).toString());
             targetHandle = ensureHandle(targetID);
@@ -659,7 +823,7 @@ Tp::BaseChannelPtr MorseConnection::createChannelCB(const QVariantMap &request,
     case Tp::HandleTypeRoom:
         if (request.contains(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandle"))) {
             targetHandle = request.value(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandle")).toUInt();
-            targetID = m_chatHandles.value(targetHandle);
+            targetID = m_chatHandles.peer(targetHandle);
         } else if (request.contains(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetID"))) {
             targetID = Telegram::Peer::fromString(request.value(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetID")).toString());
             targetHandle = ensureHandle(targetID);
@@ -676,7 +840,7 @@ Tp::BaseChannelPtr MorseConnection::createChannelCB(const QVariantMap &request,
         initiatorHandle = request.value(TP_QT_IFACE_CHANNEL + QLatin1String(".InitiatorHandle"), selfHandle()).toUInt();
     }
 
-    qDebug() << "MorseConnection::createChannel " << channelType
+    qCDebug(lcMorseChannel) << "MorseConnection::createChannel " << channelType
              << targetHandleType
              << targetHandle
              << request;
@@ -715,12 +879,18 @@ Tp::BaseChannelPtr MorseConnection::createChannelCB(const QVariantMap &request,
         connect(textChannel.data(), &MorseTextChannel::messageAcknowledged,
                 m_dataStorage, &MorseDataStorage::scheduleSave);
 
-        if (targetHandleType == Tp::HandleTypeRoom) {
-            connect(this, &MorseConnection::chatDetailsChanged,
-                    textChannel.data(), &MorseTextChannel::onChatDetailsChanged);
+        m_textChannels.insert(targetID, textChannel.data());
+        // The deferred history of the peer is needed now
+        m_syncScheduler->prioritize(targetID);
+        const QPointer<MorseTextChannel> channelPointer = textChannel.data();
+        connect(baseChannel.data(), &Tp::BaseChannel::closed, this, [this, targetID, channelPointer]() {
+            // The peer may already have a newer channel
+            if (m_textChannels.value(targetID) == channelPointer) {
+                m_textChannels.remove(targetID);
+            }
+        });
 
-            // onChatChanged(targetID.id);
-        }
+        // The chat events are dispatched to the channel via m_textChannels
     }
 
     return baseChannel;
@@ -734,6 +904,11 @@ MorseTextChannelPtr MorseConnection::ensureTextChannel(const Peer &peer)
         return MorseTextChannelPtr();
     }
 
+    const QPointer<MorseTextChannel> existingChannel = m_textChannels.value(peer);
+    if (existingChannel) {
+        return MorseTextChannelPtr(existingChannel.data());
+    }
+
     uint targetHandle = ensureHandle(peer);
 
     //TODO: initiator should be group creator
@@ -747,14 +922,14 @@ MorseTextChannelPtr MorseConnection::ensureTextChannel(const Peer &peer)
     Tp::BaseChannelPtr channel = ensureChannel(request, yours, /* suppressHandler */ false, &error);
 
     if (error.isValid()) {
-        qWarning() << Q_FUNC_INFO << "ensureChannel failed:" << error.name() << " " << error.message();
+        qCWarning(lcMorseChannel) << Q_FUNC_INFO << "ensureChannel failed:" << error.name() << " " << error.message();
         return MorseTextChannelPtr();
     }
 
     MorseTextChannelPtr textChannel = MorseTextChannelPtr::dynamicCast(channel->interface(TP_QT_IFACE_CHANNEL_TYPE_TEXT));
 
     if (!textChannel) {
-        qCritical() << Q_FUNC_INFO << "Error, channel is not a morseTextChannel?";
+        qCCritical(lcMorseChannel) << Q_FUNC_INFO << "Error, channel is not a morseTextChannel?";
     }
 
     return textChannel;
@@ -762,7 +937,8 @@ MorseTextChannelPtr MorseConnection::ensureTextChannel(const Peer &peer)
 
 Tp::UIntList MorseConnection::requestHandles(uint handleType, const QStringList &identifiers, Tp::DBusError *error)
 {
-    qDebug() << Q_FUNC_INFO << identifiers;
+    MORSE_WATCHDOG_SCOPE();
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO << identifiers;
 
     if (handleType != Tp::HandleTypeContact) {
         error->set(TP_QT_ERROR_INVALID_ARGUMENT, QLatin1String("MorseConnection::requestHandles - Handle Type unknown"));
@@ -784,63 +960,127 @@ Tp::UIntList MorseConnection::requestHandles(uint handleType, const QStringList
 
 Tp::ContactAttributesMap MorseConnection::getContactListAttributes(const QStringList &interfaces, bool /* hold */, Tp::DBusError *error)
 {
+    MORSE_WATCHDOG_SCOPE();
     return getContactAttributes(m_contactList.toList(), interfaces, error);
 }
 
 Tp::ContactAttributesMap MorseConnection::getContactAttributes(const Tp::UIntList &handles, const QStringList &interfaces, Tp::DBusError *error)
 {
+    MORSE_WATCHDOG_SCOPE();
+    // The roster is readable before connect, so decode the cached state on the first query
+    m_dataStorage->ensureStateLoaded();
+    MorseMetrics::ScopedTimer timer(m_metrics.data(), MorseMetrics::ContactAttributesDuration);
 //    http://telepathy.freedesktop.org/spec/Connection_Interface_Contacts.html#Method:GetContactAttributes
-//    qDebug() << Q_FUNC_INFO << handles << interfaces;
+//    qCDebug(lcMorseConnection) << Q_FUNC_INFO << handles << interfaces;
+    Q_UNUSED(error)
+
+    const uint interfacesMask = getContactAttributeInterfaces(interfaces);
 
     Tp::ContactAttributesMap contactAttributes;
+    Tp::UIntList missingHandles;
 
     foreach (const uint handle, handles) {
+        const auto it = m_contactAttributesCache.constFind(handle);
+        if ((it != m_contactAttributesCache.constEnd()) && (it->interfaces == interfacesMask)) {
+            contactAttributes.insert(handle, it->attributes);
+            continue;
+        }
         if (m_contactHandles.contains(handle)) {
-            QVariantMap attributes;
-            const Telegram::Peer identifier = m_contactHandles.value(handle);
-            if (!identifier.isValid()) {
-                qWarning() << Q_FUNC_INFO << "Handle is in map, but identifier is not valid";
-                continue;
-            }
-            attributes[TP_QT_IFACE_CONNECTION + QLatin1String("/contact-id")] = identifier.toString();
+            missingHandles.append(handle);
+        }
+    }
 
-            Telegram::UserInfo info;
-            if (!m_client->dataStorage()->getUserInfo(&info, identifier.id())) {
-                qWarning() << Q_FUNC_INFO << "Unknown userId" << identifier.id();
-            }
+    if (missingHandles.isEmpty()) {
+        return contactAttributes;
+    }
 
-            if (interfaces.contains(TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_LIST)) {
-                attributes[TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_LIST + QLatin1String("/subscribe")] = Tp::SubscriptionStateYes;
-                attributes[TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_LIST + QLatin1String("/publish")] = Tp::SubscriptionStateYes;
-            }
+    Tp::SimpleContactPresences presences;
+    if (interfacesMask & ContactAttributeSimplePresence) {
+        presences = simplePresenceIface->getPresences(missingHandles);
+    }
 
-            if (interfaces.contains(TP_QT_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE)) {
-                attributes[TP_QT_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE + QLatin1String("/presence")] = QVariant::fromValue(getPresence(handle));
-            }
+    foreach (const uint handle, missingHandles) {
+        QVariantMap attributes;
+        const Telegram::Peer identifier = m_contactHandles.peer(handle);
+        if (!identifier.isValid()) {
+            qCWarning(lcMorseConnection) << Q_FUNC_INFO << "Handle is in map, but identifier is not valid";
+            continue;
+        }
+        attributes[TP_QT_IFACE_CONNECTION + QLatin1String("/contact-id")] = identifier.toString();
 
-            if (interfaces.contains(TP_QT_IFACE_CONNECTION_INTERFACE_ALIASING)) {
-                attributes[TP_QT_IFACE_CONNECTION_INTERFACE_ALIASING + QLatin1String("/alias")] = QVariant::fromValue(info.getBestDisplayName());
-            }
+        Telegram::UserInfo info;
+        if (!m_client->dataStorage()->getUserInfo(&info, identifier.id())) {
+            qCWarning(lcMorseConnection) << Q_FUNC_INFO << "Unknown userId" << identifier.id();
+        }
 
-            if (interfaces.contains(TP_QT_IFACE_CONNECTION_INTERFACE_AVATARS)) {
-                Telegram::FileInfo pictureInfo;
-                if (info.getPeerPicture(&pictureInfo, Telegram::PeerPictureSize::Small)) {
-                    attributes[TP_QT_IFACE_CONNECTION_INTERFACE_AVATARS + QLatin1String("/token")] = QVariant::fromValue(pictureInfo.getFileId());
-                }
-            }
+        if (interfacesMask & ContactAttributeContactList) {
+            attributes[TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_LIST + QLatin1String("/subscribe")] = Tp::SubscriptionStateYes;
+            attributes[TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_LIST + QLatin1String("/publish")] = Tp::SubscriptionStateYes;
+        }
 
-            if (interfaces.contains(TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_INFO)) {
-                attributes[TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_INFO + QLatin1String("/info")] = QVariant::fromValue(getUserInfo(identifier.id()));
+        if (interfacesMask & ContactAttributeSimplePresence) {
+            attributes[TP_QT_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE + QLatin1String("/presence")] = QVariant::fromValue(presences.value(handle));
+        }
+
+        if (interfacesMask & ContactAttributeAliasing) {
+            attributes[TP_QT_IFACE_CONNECTION_INTERFACE_ALIASING + QLatin1String("/alias")] = QVariant::fromValue(info.getBestDisplayName());
+        }
+
+        if (interfacesMask & ContactAttributeAvatars) {
+            Telegram::FileInfo pictureInfo;
+            if (info.getPeerPicture(&pictureInfo, Telegram::PeerPictureSize::Small)) {
+                attributes[TP_QT_IFACE_CONNECTION_INTERFACE_AVATARS + QLatin1String("/token")] = QVariant::fromValue(pictureInfo.getFileId());
             }
+        }
 
-            contactAttributes[handle] = attributes;
+        if (interfacesMask & ContactAttributeContactInfo) {
+            attributes[TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_INFO + QLatin1String("/info")] = QVariant::fromValue(getUserInfo(identifier.id()));
         }
+
+        ContactAttributesCacheEntry &entry = m_contactAttributesCache[handle];
+        entry.interfaces = interfacesMask;
+        entry.attributes = attributes;
+
+        contactAttributes.insert(handle, attributes);
     }
     return contactAttributes;
 }
 
+uint MorseConnection::getContactAttributeInterfaces(const QStringList &interfaces)
+{
+    uint result = 0;
+    for (const QString &interface : interfaces) {
+        if (interface == TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_LIST) {
+            result |= ContactAttributeContactList;
+        } else if (interface == TP_QT_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE) {
+            result |= ContactAttributeSimplePresence;
+        } else if (interface == TP_QT_IFACE_CONNECTION_INTERFACE_ALIASING) {
+            result |= ContactAttributeAliasing;
+        } else if (interface == TP_QT_IFACE_CONNECTION_INTERFACE_AVATARS) {
+            result |= ContactAttributeAvatars;
+        } else if (interface == TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_INFO) {
+            result |= ContactAttributeContactInfo;
+        }
+    }
+    return result;
+}
+
+/*
+ * The cached attributes are dropped where the user info changes: the presence and avatar
+ * updates, the contact list changes, the dialogs (re)load and the incoming messages, which
+ * carry the sender user info. TelegramQt has no notification for the other user updates
+ * (e.g. updateUserName), so those are picked up on the next of these events.
+ */
+void MorseConnection::invalidateContactAttributes(uint handle)
+{
+    if (handle) {
+        m_contactAttributesCache.remove(handle);
+    }
+}
+
 void MorseConnection::removeContacts(const Tp::UIntList &handles, Tp::DBusError *error)
 {
+    MORSE_WATCHDOG_SCOPE();
     if (handles.isEmpty()) {
         error->set(TP_QT_ERROR_INVALID_HANDLE, QLatin1String("Invalid argument (no handles provided)"));
     }
@@ -857,7 +1097,7 @@ void MorseConnection::removeContacts(const Tp::UIntList &handles, Tp::DBusError
             return;
         }
 
-        quint32 userId = m_contactHandles.value(handle).id();
+        quint32 userId = m_contactHandles.peer(handle).id();
 
         if (!userId) {
             error->set(TP_QT_ERROR_INVALID_HANDLE, QLatin1String("Internal error (invalid handle)"));
@@ -871,13 +1111,15 @@ void MorseConnection::removeContacts(const Tp::UIntList &handles, Tp::DBusError
 
 Tp::ContactInfoFieldList MorseConnection::requestContactInfo(uint handle, Tp::DBusError *error)
 {
-    qDebug() << Q_FUNC_INFO << handle;
+    MORSE_WATCHDOG_SCOPE();
+    m_dataStorage->ensureStateLoaded();
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO << handle;
 
     if (!m_contactHandles.contains(handle)) {
         error->set(TP_QT_ERROR_INVALID_HANDLE, QLatin1String("Invalid handle"));
         return Tp::ContactInfoFieldList();
     }
-    Telegram::Peer identifier = m_contactHandles.value(handle);
+    Telegram::Peer identifier = m_contactHandles.peer(handle);
     if (!identifier.isValid()) {
         error->set(TP_QT_ERROR_INVALID_HANDLE, QLatin1String("Invalid morse identifier"));
         return Tp::ContactInfoFieldList();
@@ -937,7 +1179,9 @@ Tp::ContactInfoFieldList MorseConnection::getUserInfo(const quint32 userId) cons
 
 Tp::ContactInfoMap MorseConnection::getContactInfo(const Tp::UIntList &contacts, Tp::DBusError *error)
 {
-    qDebug() << Q_FUNC_INFO << contacts;
+    MORSE_WATCHDOG_SCOPE();
+    m_dataStorage->ensureStateLoaded();
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO << contacts;
 
     if (contacts.isEmpty()) {
         return Tp::ContactInfoMap();
@@ -957,7 +1201,9 @@ Tp::ContactInfoMap MorseConnection::getContactInfo(const Tp::UIntList &contacts,
 
 Tp::AliasMap MorseConnection::getAliases(const Tp::UIntList &handles, Tp::DBusError *error)
 {
-    qDebug() << Q_FUNC_INFO << handles;
+    MORSE_WATCHDOG_SCOPE();
+    m_dataStorage->ensureStateLoaded();
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO << handles;
 
     Tp::AliasMap aliases;
 
@@ -970,7 +1216,7 @@ Tp::AliasMap MorseConnection::getAliases(const Tp::UIntList &handles, Tp::DBusEr
 
 QString MorseConnection::getContactAlias(uint handle)
 {
-    return getAlias(m_contactHandles.value(handle));
+    return getAlias(m_contactHandles.peer(handle));
 }
 
 QString MorseConnection::getAlias(const Telegram::Peer identifier)
@@ -1004,7 +1250,8 @@ Tp::SimplePresence MorseConnection::getPresence(uint handle)
 
 uint MorseConnection::setPresence(const QString &status, const QString &message, Tp::DBusError *error)
 {
-    qDebug() << Q_FUNC_INFO << status;
+    MORSE_WATCHDOG_SCOPE();
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO << status;
     Q_UNUSED(message)
     Q_UNUSED(error)
 
@@ -1050,17 +1297,7 @@ uint MorseConnection::ensureContact(const Telegram::Peer &identifier)
 
 uint MorseConnection::ensureChat(const Telegram::Peer &identifier)
 {
-    uint handle = getChatHandle(identifier);
-    if (!handle) {
-        if (m_chatHandles.isEmpty()) {
-            handle = 1;
-        } else {
-            handle = m_chatHandles.keys().last() + 1;
-        }
-
-        m_chatHandles.insert(handle, identifier);
-    }
-    return handle;
+    return m_chatHandles.ensureHandle(identifier);
 }
 
 Telegram::Peer MorseConnection::selfPeer() const
@@ -1070,11 +1307,7 @@ Telegram::Peer MorseConnection::selfPeer() const
 
 quint64 MorseConnection::getSentMessageToken(const Peer &dialog, quint32 messageId) const
 {
-    if (m_sentMessageMap.contains(dialog)) {
-        const SentMessageMap &map = m_sentMessageMap[dialog];
-        return map.value(messageId);
-    }
-    return 0;
+    return m_dataStorage->getSentMessageRandomId(dialog, messageId);
 }
 
 QString MorseConnection::getMessageToken(const Peer &dialog, quint32 messageId) const
@@ -1091,11 +1324,7 @@ quint32 MorseConnection::getMessageId(const Peer &dialog, const QString &message
         return 0;
     }
 
-    quint32 messageId = 0;
-    if (m_sentMessageMap.contains(dialog)) {
-        const SentMessageMap &map = m_sentMessageMap[dialog];
-        messageId = map.key(messageId64);
-    }
+    quint32 messageId = m_dataStorage->getSentMessageId(dialog, messageId64);
 
     if (!messageId && !(messageId64 >> 32)) {
         messageId = static_cast<quint32>(messageId64);
@@ -1111,32 +1340,18 @@ quint32 MorseConnection::getMessageId(const Peer &dialog, const QString &message
  */
 uint MorseConnection::addContacts(const QVector<Telegram::Peer> &identifiers)
 {
-    qDebug() << Q_FUNC_INFO;
-    uint handle = 0;
-
-    if (!m_contactHandles.isEmpty()) {
-        handle = m_contactHandles.keys().last();
-    }
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO;
 
-    QList<uint> newHandles;
-    QVector<Telegram::Peer> newIdentifiers;
     for (const Telegram::Peer &identifier : identifiers) {
-        if (getContactHandle(identifier)) {
-            continue;
-        }
-
-        ++handle;
-        m_contactHandles.insert(handle, identifier);
-        newHandles << handle;
-        newIdentifiers << identifier;
+        m_contactHandles.ensureHandle(identifier);
     }
 
-    return handle;
+    return m_contactHandles.lastHandle();
 }
 
 void MorseConnection::updateContactsPresence(const QVector<Telegram::Peer> &identifiers)
 {
-    qDebug() << Q_FUNC_INFO;
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO;
     Tp::SimpleContactPresences newPresences;
     for (const Telegram::Peer &identifier : identifiers) {
         uint handle = ensureContact(identifier);
@@ -1156,8 +1371,18 @@ void MorseConnection::updateContactsPresence(const QVector<Telegram::Peer> &iden
             }
         }
 
+        const auto it = m_contactStatuses.constFind(handle);
+        if ((it != m_contactStatuses.constEnd()) && (it.value() == st)) {
+            continue;
+        }
+        m_contactStatuses.insert(handle, st);
+        invalidateContactAttributes(handle);
         newPresences[handle] = telegramStatusToTelepathyPresence(st);
     }
+
+    if (newPresences.isEmpty()) {
+        return;
+    }
     simplePresenceIface->setPresences(newPresences);
 }
 
@@ -1174,24 +1399,131 @@ void MorseConnection::updateSelfContactState(Tp::ConnectionStatus status)
     }
 
     newPresences[selfHandle()] = presence;
+    invalidateContactAttributes(selfHandle());
     simplePresenceIface->setPresences(newPresences);
 }
 
 void MorseConnection::onSyncMessagesReceived(const Peer &peer, const QVector<quint32> &messages)
 {
+    MORSE_WATCHDOG_SCOPE();
+    m_syncScheduler->onPeerSynced(peer);
+
     // Telegram always sort messages from new to old.
     // Workaround KTp not sorting messages by timestamp
     // by reversing the order from old to new.
 
     QVector<quint32> reversedMessages = messages;
     std::reverse(reversedMessages.begin(), reversedMessages.end());
-    addMessages(peer, reversedMessages);
+    enqueueBacklog(peer, reversedMessages);
 }
 
 /* Receive message from outside (telegram server) */
 void MorseConnection::onNewMessageReceived(const Peer peer, quint32 messageId)
 {
+    MORSE_WATCHDOG_SCOPE();
+    m_metrics->increment(MorseMetrics::MessagesReceived);
+    m_messageTracer.begin(peer, messageId);
+    if (m_backlog.contains(peer)) {
+        // Keep the order: the new message goes after the pending history.
+        // Its delivery waits for the backlog, so it is left out of ReceiveLatency;
+        // the trace shows the wait as the queued stage.
+        m_messageTracer.queue();
+        enqueueBacklog(peer, {messageId});
+        return;
+    }
+    QElapsedTimer timer;
+    timer.start();
     addMessages(peer, {messageId});
+    m_metrics->record(MorseMetrics::ReceiveLatency, timer);
+    m_messageTracer.finish();
+}
+
+/*
+ * The synced history is delivered in time slices, so a large backlog does not block the
+ * main loop (and the D-Bus interface). The dialogs are served in the dialog list order,
+ * i.e. the most recently active dialogs go first.
+ */
+void MorseConnection::enqueueBacklog(const Peer &peer, const QVector<quint32> &messageIds)
+{
+    if (messageIds.isEmpty()) {
+        return;
+    }
+
+    auto it = m_backlog.find(peer);
+    if (it == m_backlog.end()) {
+        PendingBacklog backlog;
+        backlog.queueKey = BacklogQueueKey(m_dialogRanks.value(peer, INT_MAX), ++m_backlogSequence);
+        it = m_backlog.insert(peer, backlog);
+        m_backlogQueue.insert(backlog.queueKey, peer);
+    }
+    it->messageIds += messageIds;
+
+    if (!m_backlogTimer) {
+        m_backlogTimer = new QTimer(this);
+        m_backlogTimer->setSingleShot(true);
+        m_backlogTimer->setInterval(0);
+        connect(m_backlogTimer, &QTimer::timeout, this, &MorseConnection::deliverBacklog);
+    }
+    if (!m_backlogTimer->isActive()) {
+        m_backlogTimer->start();
+    }
+}
+
+void MorseConnection::deliverBacklog()
+{
+    MORSE_WATCHDOG_SCOPE();
+    QElapsedTimer timer;
+    timer.start();
+
+    while (!m_backlogQueue.isEmpty()) {
+        const Peer peer = m_backlogQueue.first();
+        // The channel creation and the delivery may re-enter enqueueBacklog() and rehash
+        // m_backlog, so the entry is looked up again after each of these calls
+        MorseTextChannelPtr textChannel = ensureTextChannel(peer);
+
+        forever {
+            const auto it = m_backlog.find(peer);
+            if (it == m_backlog.end()) {
+                if (!m_backlogQueue.isEmpty() && (m_backlogQueue.first() == peer)) {
+                    m_backlogQueue.erase(m_backlogQueue.begin());
+                }
+                break;
+            }
+            if (!textChannel || (it->position >= it->messageIds.count())) {
+                m_backlogQueue.remove(it->queueKey);
+                m_backlog.erase(it);
+                break;
+            }
+            const quint32 messageId = it->messageIds.at(it->position);
+            ++it->position;
+
+            // Continue the trace of a live message queued behind the backlog
+            if (m_messageTracer.resume(peer, messageId)) {
+                m_messageTracer.stamp(MorseMessageTracer::StageGetMessage);
+            }
+            Telegram::Message message;
+            m_client->dataStorage()->getMessage(&message, peer, messageId);
+            m_messageTracer.setServerDate(message.timestamp());
+            textChannel->onMessageReceived(message);
+            m_messageTracer.finish();
+
+            if (timer.elapsed() >= c_backlogTimeSlice) {
+                // Yield to the event loop and continue on the next iteration
+                m_backlogTimer->start();
+                return;
+            }
+        }
+    }
+}
+
+void MorseConnection::clearBacklog()
+{
+    m_backlog.clear();
+    m_backlogQueue.clear();
+    m_messageTracer.clearQueued();
+    if (m_backlogTimer) {
+        m_backlogTimer->stop();
+    }
 }
 
 void MorseConnection::addMessages(const Peer peer, const QVector<quint32> &messageIds)
@@ -1201,6 +1533,7 @@ void MorseConnection::addMessages(const Peer peer, const QVector<quint32> &messa
         return;
     }
 
+    m_messageTracer.stamp(MorseMessageTracer::StageEnsureChannel);
     MorseTextChannelPtr textChannel = ensureTextChannel(peer);
 
     if (!textChannel) {
@@ -1208,14 +1541,19 @@ void MorseConnection::addMessages(const Peer peer, const QVector<quint32> &messa
     }
 
     for (const quint32 messageId : newIds) {
+        m_messageTracer.stamp(MorseMessageTracer::StageGetMessage);
         Telegram::Message message;
         m_client->dataStorage()->getMessage(&message, peer, messageId);
+        m_messageTracer.setServerDate(message.timestamp());
+        // The update brings the sender user info along with the message
+        invalidateContactAttributes(m_contactHandles.handle(Telegram::Peer::fromUserId(message.fromUserId())));
         textChannel->onMessageReceived(message);
     }
 }
 
 void MorseConnection::updateContactList()
 {
+    MORSE_WATCHDOG_SCOPE();
     if (m_client->connectionApi()->status() != Client::ConnectionApi::StatusReady) {
         return;
     }
@@ -1224,13 +1562,48 @@ void MorseConnection::updateContactList()
 #else
     const QVector<Telegram::Peer> ids = m_contacts->peers();
 #endif
+    setContactList(ids);
+}
+
+/*
+ * Publish the roster restored from the state file, so the clients do not wait for the
+ * dialogs to be fetched from the server. updateContactList() reconciles it with a diff later.
+ */
+void MorseConnection::publishCachedContactList()
+{
+#ifdef DIALOGS_AS_CONTACTLIST
+    if (!m_contactList.isEmpty()) {
+        return;
+    }
+    const QVector<Telegram::Peer> ids = m_client->dataStorage()->dialogs();
+    if (ids.isEmpty()) {
+        return;
+    }
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO << ids.count() << "cached dialogs";
+
+    // Bind the self handle first to not allocate another handle for the self dialog
+    const quint32 selfUserId = m_client->dataStorage()->selfUserId();
+    if (selfUserId && !m_contactHandles.peer(c_selfHandle).isValid()) {
+        m_contactHandles.setPeer(c_selfHandle, Telegram::Peer::fromUserId(selfUserId));
+    }
+    setContactList(ids);
+#endif
+}
 
-    qDebug() << this << __func__ << "ids:" << ids;
+void MorseConnection::setContactList(const QVector<Telegram::Peer> &ids)
+{
+    qCDebug(lcMorseConnection) << this << __func__ << ids.count() << "ids";
 
     QVector<uint> newContactListHandles;
     QVector<Telegram::Peer> newContactListIdentifiers;
+    QSet<uint> newContactListSet;
     newContactListHandles.reserve(ids.count());
     newContactListIdentifiers.reserve(ids.count());
+    newContactListSet.reserve(ids.count());
+
+    // Only the contacts which were not in the list yet are announced
+    Tp::ContactSubscriptionMap changes;
+    Tp::HandleIdentifierMap identifiersMap;
 
     for (const Telegram::Peer &peer : ids) {
         if (peerIsRoom(peer)) {
@@ -1240,114 +1613,192 @@ void MorseConnection::updateContactList()
         if (peer.type() == Telegram::Peer::User) {
             m_client->dataStorage()->getUserInfo(&info, peer.id());
             if (info.isDeleted()) {
-                qDebug() << this << __func__ << "skip deleted" << peer;
+                qCDebug(lcMorseConnection) << this << __func__ << "skip deleted" << peer;
                 continue;
             }
         }
+        const uint handle = ensureContact(peer);
+        if (newContactListSet.contains(handle)) {
+            continue;
+        }
+        newContactListSet.insert(handle);
+        newContactListHandles.append(handle);
         newContactListIdentifiers.append(peer);
-        newContactListHandles.append(ensureContact(newContactListIdentifiers.last()));
+
+        if (m_contactListSet.contains(handle)) {
+            continue;
+        }
+
+        Tp::ContactSubscriptions change;
+        change.publish = Tp::SubscriptionStateYes;
+        change.subscribe = Tp::SubscriptionStateYes;
+        changes.insert(handle, change);
+        identifiersMap.insert(handle, peer.toString());
     }
 
     Tp::HandleIdentifierMap removals;
-    foreach (uint handle, m_contactList) {
-        if (newContactListHandles.contains(handle)) {
+    for (const uint handle : m_contactList) {
+        if (newContactListSet.contains(handle)) {
             continue;
         }
-        const Telegram::Peer identifier = m_contactHandles.value(handle);
+        const Telegram::Peer identifier = m_contactHandles.peer(handle);
         if (!identifier.isValid()) {
-            qWarning() << this << __func__ << "Internal corruption. Handle" << handle << "has invalid corresponding identifier";
+            qCWarning(lcMorseConnection) << this << __func__ << "Internal corruption. Handle" << handle << "has invalid corresponding identifier";
         }
         removals.insert(handle, identifier.toString());
+        m_contactStatuses.remove(handle);
     }
 
     m_contactList = newContactListHandles;
+    m_contactListSet.swap(newContactListSet);
 
-    qDebug() << this << __func__ << "new:" << newContactListIdentifiers;
-    qDebug() << this << __func__ << "removals:" << removals;
-    Tp::ContactSubscriptionMap changes;
-    Tp::HandleIdentifierMap identifiersMap;
-
-    for (int i = 0; i < newContactListIdentifiers.size(); ++i) {
-        Tp::ContactSubscriptions change;
-        change.publish = Tp::SubscriptionStateYes;
-        change.subscribe = Tp::SubscriptionStateYes;
-        changes[newContactListHandles[i]] = change;
-        identifiersMap[newContactListHandles[i]] = newContactListIdentifiers.at(i).toString();
+    // The contact list membership is a part of the attributes
+    for (auto it = changes.constBegin(); it != changes.constEnd(); ++it) {
+        invalidateContactAttributes(it.key());
     }
+    for (auto it = removals.constBegin(); it != removals.constEnd(); ++it) {
+        invalidateContactAttributes(it.key());
+    }
+
+    qCDebug(lcMorseConnection) << this << __func__ << "added:" << changes.count() << "removed:" << removals.count();
 
-    contactListIface->contactsChangedWithID(changes, identifiersMap, removals);
+    if (!changes.isEmpty() || !removals.isEmpty()) {
+        contactListIface->contactsChangedWithID(changes, identifiersMap, removals);
+    }
 
+    // Publishes only the presences which differ from the last published ones
     updateContactsPresence(newContactListIdentifiers);
 
-    contactListIface->setContactListState(Tp::ContactListStateSuccess);
+    if (contactListIface->contactListState() != Tp::ContactListStateSuccess) {
+        contactListIface->setContactListState(Tp::ContactListStateSuccess);
+    }
 }
 
 void MorseConnection::onDialogsReady()
 {
+    MORSE_WATCHDOG_SCOPE();
     bool m_omitGroupChats = true;
-    Telegram::PeerList interestingPeers;
-    for (const Telegram::Peer &peer : m_dialogs->peers()) {
+    const QVector<Telegram::Peer> dialogPeers = m_dialogs->peers();
+    m_dialogRanks.clear();
+    m_dialogRanks.reserve(dialogPeers.count());
+    for (int i = 0; i < dialogPeers.count(); ++i) {
+        m_dialogRanks.insert(dialogPeers.at(i), i);
+    }
+    QVector<MorseSyncScheduler::Dialog> interestingDialogs;
+    for (const Telegram::Peer &peer : dialogPeers) {
         if (m_omitGroupChats) {
             if (peerIsRoom(peer)) {
                 continue;
             }
         }
-        interestingPeers.append(peer);
+        MorseSyncScheduler::Dialog dialog;
+        Telegram::DialogInfo dialogInfo;
+        if (m_client->dataStorage()->getDialogInfo(&dialogInfo, peer)) {
+            dialog.unreadCount = static_cast<int>(dialogInfo.unreadCount());
+        }
+        dialog.peer = peer;
+        dialog.rank = m_dialogRanks.value(peer);
+        interestingDialogs.append(dialog);
+    }
+    m_syncScheduler->schedule(interestingDialogs);
+    m_dialogsSynced = true;
+
+    // The user info of the dialog peers is reloaded along with the dialogs
+    for (const Telegram::Peer &peer : dialogPeers) {
+        invalidateContactAttributes(m_contactHandles.handle(peer));
     }
-    m_client->messagingApi()->syncPeers(interestingPeers);
 
     updateContactList();
 }
 
 void MorseConnection::onDisconnected()
 {
-    qDebug() << Q_FUNC_INFO;
+    MORSE_WATCHDOG_SCOPE();
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO;
     saveState();
+    m_reconnectController->stop();
+    m_networkReset = false;
+    if (m_client->connectionApi()->status() == Client::ConnectionApi::StatusDisconnected) {
+        // Waiting for a reconnection; there is no server connection to close
+        onConnectionStatusChanged(Client::ConnectionApi::StatusDisconnected, Client::ConnectionApi::StatusReasonLocal);
+        return;
+    }
     m_client->connectionApi()->disconnectFromServer();
 }
 
-void MorseConnection::onAvatarRequestFinished(Telegram::Client::FileOperation *fileOperation, const Peer &peer)
+void MorseConnection::onAvatarDownloaded(const QString &fileId, const QByteArray &data,
+                                         const QString &mimeType, const QVector<Peer> &peers)
 {
-    const Telegram::FileInfo *fileInfo = fileOperation->fileInfo();
-    const QString fileId = fileInfo->getFileId();
-    qDebug() << Q_FUNC_INFO << fileId << fileOperation;
-    fileOperation->deleteLater();
+    m_metrics->increment(MorseMetrics::AvatarsFetched);
+    // Fit the image into avatarDetails() before it goes to the cache and to the clients
+    m_avatarTranscoder->transcode(fileId, data, mimeType, peers);
+}
 
-    if (m_peerPictureRequests.contains(fileId)) {
-        if (fileOperation->isFailed()) {
-            qWarning() << Q_FUNC_INFO << "Operation failed:" << fileOperation->errorDetails();
-            // It seems that the Telepathy spec doesn't cover avatar request fails. It says:
-            //    If the handles are valid but retrieving an avatar fails (for any reason, including
-            //    the contact not having an avatar) the AvatarRetrieved signal is not emitted for
-            //    that contact.
-            // Do nothing but the warning.
-            return;
-        }
-        const QByteArray data = fileOperation->device()->readAll();
-        if (!peerIsRoom(peer)) {
-            uint handle = ensureContact(peer);
-            avatarsIface->avatarRetrieved(handle, fileId, data, fileInfo->mimeType());
-        } else {
-            qDebug() << "MorseConnection::onFileRequestCompleted(): Ignore room picture";
+void MorseConnection::onAvatarTranscoded(const QString &fileId, const QByteArray &data,
+                                         const QString &mimeType, const QVector<Peer> &peers)
+{
+    MORSE_WATCHDOG_SCOPE();
+    m_avatarCache->insert(fileId, data, mimeType);
+    for (const Peer &peer : peers) {
+        if (peerIsRoom(peer)) {
+            qCDebug(lcMorseAvatars) << Q_FUNC_INFO << "Ignore room picture";
+            continue;
         }
-    } else {
-        qWarning() << "MorseConnection::onFileRequestCompleted(): Unexpected file id";
+        uint handle = ensureContact(peer);
+        invalidateContactAttributes(handle);
+        avatarsIface->avatarRetrieved(handle, fileId, data, mimeType);
     }
 }
 
 void MorseConnection::onMessageSent(const Peer &peer, quint64 messageRandomId, quint32 messageId)
 {
+    MORSE_WATCHDOG_SCOPE();
     MorseTextChannelPtr textChannel = ensureTextChannel(peer);
 
     if (!textChannel) {
         return;
     }
 
-    m_sentMessageMap[peer].insert(messageId, messageRandomId);
+    m_dataStorage->addSentMessage(peer, messageId, messageRandomId);
+    m_metrics->increment(MorseMetrics::MessagesSent);
 
     textChannel->onMessageSent(messageRandomId, messageId);
 }
 
+/* The channel events are routed to the channel of the peer, if it is open */
+MorseTextChannel *MorseConnection::findTextChannel(const Peer &peer) const
+{
+    return m_textChannels.value(peer).data();
+}
+
+void MorseConnection::onMessageActionChanged(const Peer &peer, quint32 userId, const MessageAction &action)
+{
+    if (MorseTextChannel *textChannel = findTextChannel(peer)) {
+        textChannel->setMessageAction(userId, action);
+    }
+}
+
+void MorseConnection::onMessageReadInbox(const Peer &peer, quint32 messageId)
+{
+    if (MorseTextChannel *textChannel = findTextChannel(peer)) {
+        textChannel->setMessageInboxRead(messageId);
+    }
+}
+
+void MorseConnection::onMessageReadOutbox(const Peer &peer, quint32 messageId)
+{
+    if (MorseTextChannel *textChannel = findTextChannel(peer)) {
+        textChannel->setMessageOutboxRead(messageId);
+    }
+}
+
+void MorseConnection::onChatDetailsChanged(const Peer &peer, const Tp::UIntList &handles)
+{
+    if (MorseTextChannel *textChannel = findTextChannel(peer)) {
+        textChannel->updateChatDetails(handles);
+    }
+}
+
 void MorseConnection::onContactStatusChanged(quint32 userId, Namespace::ContactStatus status)
 {
     uint handle = ensureContact(userId);
@@ -1355,6 +1806,8 @@ void MorseConnection::onContactStatusChanged(quint32 userId, Namespace::ContactS
         // Ignore self contact status changes
         return;
     }
+    m_contactStatuses.insert(handle, status);
+    invalidateContactAttributes(handle);
     Tp::SimpleContactPresences newPresences;
     newPresences[handle] = telegramStatusToTelepathyPresence(status);
     simplePresenceIface->setPresences(newPresences);
@@ -1362,7 +1815,7 @@ void MorseConnection::onContactStatusChanged(quint32 userId, Namespace::ContactS
 
 void MorseConnection::onGotRooms()
 {
-    qDebug() << Q_FUNC_INFO;
+    qCDebug(lcMorseChannel) << Q_FUNC_INFO;
     Tp::RoomInfoList rooms;
 
     const QVector<Telegram::Peer> dialogs = m_client->dataStorage()->dialogs();
@@ -1396,7 +1849,7 @@ void MorseConnection::onGotRooms()
 
 Tp::BaseChannelPtr MorseConnection::createRoomListChannel()
 {
-    qDebug() << Q_FUNC_INFO;
+    qCDebug(lcMorseChannel) << Q_FUNC_INFO;
     Tp::BaseChannelPtr baseChannel = Tp::BaseChannel::create(this, TP_QT_IFACE_CHANNEL_TYPE_ROOM_LIST);
 
     roomListChannel = Tp::BaseChannelRoomListType::create();
@@ -1409,6 +1862,8 @@ Tp::BaseChannelPtr MorseConnection::createRoomListChannel()
 
 Tp::AvatarTokenMap MorseConnection::getKnownAvatarTokens(const Tp::UIntList &contacts, Tp::DBusError *error)
 {
+    MORSE_WATCHDOG_SCOPE();
+    m_dataStorage->ensureStateLoaded();
     if (contacts.isEmpty()) {
         error->set(TP_QT_ERROR_INVALID_ARGUMENT, QLatin1String("No handles provided"));
     }
@@ -1425,9 +1880,9 @@ Tp::AvatarTokenMap MorseConnection::getKnownAvatarTokens(const Tp::UIntList &con
             error->set(TP_QT_ERROR_INVALID_HANDLE, QLatin1String("Invalid handle(s)"));
         }
 
-        const Peer peer = m_contactHandles.value(handle);
+        const Peer peer = m_contactHandles.peer(handle);
         if (!m_client->dataStorage()->getUserInfo(&userInfo, peer.id())) {
-            qWarning() << "requestAvatars(): Unable to get userInfo for" << peer.toString();
+            qCWarning(lcMorseAvatars) << "requestAvatars(): Unable to get userInfo for" << peer.toString();
             continue;
         }
         if (!userInfo.getPeerPicture(&pictureFile, Telegram::PeerPictureSize::Small)) {
@@ -1442,6 +1897,8 @@ Tp::AvatarTokenMap MorseConnection::getKnownAvatarTokens(const Tp::UIntList &con
 
 void MorseConnection::requestAvatars(const Tp::UIntList &contacts, Tp::DBusError *error)
 {
+    MORSE_WATCHDOG_SCOPE();
+    m_dataStorage->ensureStateLoaded();
     if (contacts.isEmpty()) {
         error->set(TP_QT_ERROR_INVALID_ARGUMENT, QLatin1String("No handles provided"));
         return;
@@ -1457,29 +1914,72 @@ void MorseConnection::requestAvatars(const Tp::UIntList &contacts, Tp::DBusError
             error->set(TP_QT_ERROR_INVALID_HANDLE, QLatin1String("Invalid handle(s)"));
             return;
         }
-        const Telegram::Peer peer = m_contactHandles.value(handle);
+        const Telegram::Peer peer = m_contactHandles.peer(handle);
         Telegram::UserInfo userInfo;
         if (!m_client->dataStorage()->getUserInfo(&userInfo, peer.id())) {
-            qWarning() << "requestAvatars(): Unable to get userInfo for" << peer.toString();
+            qCWarning(lcMorseAvatars) << "requestAvatars(): Unable to get userInfo for" << peer.toString();
             continue;
         }
         Telegram::FileInfo pictureFile;
         userInfo.getPeerPicture(&pictureFile, Telegram::PeerPictureSize::Small);
         if (!pictureFile.isValid()) {
-            qWarning() << "requestAvatars(): Unable to get peer picture info for" << peer.toString();
+            qCWarning(lcMorseAvatars) << "requestAvatars(): Unable to get peer picture info for" << peer.toString();
+            continue;
+        }
+
+        // The cached avatar is read off the main thread and reported via onAvatarLoaded()
+        if (m_avatarCache->load(pictureFile.getFileId(), { peer })) {
             continue;
         }
+        fetchAvatar(handle, peer, pictureFile);
+    }
+}
+
+void MorseConnection::fetchAvatar(uint handle, const Telegram::Peer &peer, const Telegram::FileInfo &file)
+{
+    // Fetch the avatars of the online contacts first
+    const bool online = m_contactStatuses.value(handle) == Telegram::Namespace::ContactStatusOnline;
+    m_avatarScheduler->request(peer, file, online ? 1 : 0);
+}
 
-        Telegram::Client::FileOperation *fileOperation = m_client->filesApi()->downloadFile(&pictureFile);
-        fileOperation->connectToFinished(this, &MorseConnection::onAvatarRequestFinished,
-                              fileOperation, peer);
+void MorseConnection::onAvatarLoaded(const QString &fileId, const QByteArray &data,
+                                     const QString &mimeType, const QVector<Peer> &peers)
+{
+    MORSE_WATCHDOG_SCOPE();
+    for (const Peer &peer : peers) {
+        const uint handle = m_contactHandles.handle(peer);
+        if (!handle) {
+            continue;
+        }
+        m_metrics->increment(MorseMetrics::AvatarCacheHits);
+        avatarsIface->avatarRetrieved(handle, fileId, data, mimeType);
+    }
+}
 
-        m_peerPictureRequests.insert(pictureFile.getFileId(), peer);
+void MorseConnection::onAvatarMissing(const QString &fileId, const QVector<Peer> &peers)
+{
+    MORSE_WATCHDOG_SCOPE();
+    if (status() != Tp::ConnectionStatusConnected) {
+        return;
+    }
+    for (const Peer &peer : peers) {
+        const uint handle = m_contactHandles.handle(peer);
+        Telegram::UserInfo userInfo;
+        Telegram::FileInfo pictureFile;
+        if (!handle || !m_client->dataStorage()->getUserInfo(&userInfo, peer.id())
+                || !userInfo.getPeerPicture(&pictureFile, Telegram::PeerPictureSize::Small)) {
+            continue;
+        }
+        // The picture may be changed while the file was read
+        if (pictureFile.getFileId() == fileId) {
+            fetchAvatar(handle, peer, pictureFile);
+        }
     }
 }
 
 void MorseConnection::roomListStartListing(Tp::DBusError *error)
 {
+    MORSE_WATCHDOG_SCOPE();
     Q_UNUSED(error)
 
     QTimer::singleShot(0, this, SLOT(onGotRooms()));
@@ -1488,6 +1988,7 @@ void MorseConnection::roomListStartListing(Tp::DBusError *error)
 
 void MorseConnection::roomListStopListing(Tp::DBusError *error)
 {
+    MORSE_WATCHDOG_SCOPE();
     Q_UNUSED(error)
     roomListChannel->setListingRooms(false);
 }
@@ -1523,10 +2024,10 @@ bool MorseConnection::peerIsRoom(const Telegram::Peer peer) const
 
 uint MorseConnection::getContactHandle(const Telegram::Peer &identifier) const
 {
-    return m_contactHandles.key(identifier, 0);
+    return m_contactHandles.handle(identifier);
 }
 
 uint MorseConnection::getChatHandle(const Telegram::Peer &identifier) const
 {
-    return m_chatHandles.key(identifier, 0);
+    return m_chatHandles.handle(identifier);
 }
@@ -20,6 +20,9 @@
 #ifndef MORSE_CONNECTION_HPP
 #define MORSE_CONNECTION_HPP
 
+#include "handleregistry.hpp"
+#include "messagetracer.hpp"
+
 #include <TelepathyQt/BaseConnection>
 #include <TelepathyQt/BaseChannel>
 #include <TelepathyQt/RequestableChannelClassSpec>
@@ -28,10 +31,22 @@
 #include <TelegramQt/ConnectionApi>
 #include <TelegramQt/TelegramNamespace>
 
+#include <QMap>
+#include <QPointer>
+#include <QSharedPointer>
+
+class MorseAvatarCache;
+class MorseAvatarScheduler;
+class MorseAvatarTranscoder;
 class MorseDataStorage;
 class MorseInfo;
+class MorseMetrics;
+class MorseReconnectController;
+class MorseSyncScheduler;
 class MorseTextChannel;
 
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
 using MorseTextChannelPtr = Tp::SharedPtr<MorseTextChannel>;
 
 namespace Telegram {
@@ -69,6 +84,7 @@ public:
     QStringList inspectHandles(uint handleType, const Tp::UIntList &handles, Tp::DBusError *error);
     Tp::BaseChannelPtr createChannelCB(const QVariantMap &request, Tp::DBusError *error);
     MorseTextChannelPtr ensureTextChannel(const Telegram::Peer &peer);
+    MorseTextChannel *findTextChannel(const Telegram::Peer &peer) const;
 
     Tp::UIntList requestHandles(uint handleType, const QStringList &identifiers, Tp::DBusError *error);
 
@@ -95,6 +111,8 @@ public:
     uint ensureChat(const Telegram::Peer &identifier);
 
     Telegram::Client::Client *core() const { return m_client; }
+    MorseMetrics *metrics() const { return m_metrics.data(); }
+    MorseMessageTracer *messageTracer() { return &m_messageTracer; }
     Telegram::Peer selfPeer() const;
 
     quint64 getSentMessageToken(const Telegram::Peer &dialog, quint32 messageId) const;
@@ -107,6 +125,9 @@ public slots:
     void onSyncMessagesReceived(const Telegram::Peer &peer, const QVector<quint32> &messages);
     void onNewMessageReceived(const Telegram::Peer peer, quint32 messageId);
     void addMessages(const Telegram::Peer peer, const QVector<quint32> &messageIds);
+    void enqueueBacklog(const Telegram::Peer &peer, const QVector<quint32> &messageIds);
+    void deliverBacklog();
+    void clearBacklog();
 
 signals:
     void chatDetailsChanged(const Telegram::Peer peer, const Tp::UIntList &handles);
@@ -122,13 +143,28 @@ private slots:
     void onPasswordCheckFailed();
     void onSignInFinished();
     void onCheckInFinished(Telegram::Client::AuthOperation *checkInOperation);
+    void onReconnectCheckInFinished(Telegram::Client::AuthOperation *checkInOperation);
+    void onReconnectRequested();
+    void onNetworkChanged();
     void onAccountInvalidated(const QString &accountIdentifier);
     void onConnectionReady();
     void updateContactList();
+    void publishCachedContactList();
+    void setContactList(const QVector<Telegram::Peer> &ids);
     void onDialogsReady();
     void onDisconnected();
-    void onAvatarRequestFinished(Telegram::Client::FileOperation *fileOperation, const Telegram::Peer &peer);
+    void onAvatarDownloaded(const QString &fileId, const QByteArray &data, const QString &mimeType,
+                            const QVector<Telegram::Peer> &peers);
+    void onAvatarTranscoded(const QString &fileId, const QByteArray &data, const QString &mimeType,
+                            const QVector<Telegram::Peer> &peers);
+    void onAvatarLoaded(const QString &fileId, const QByteArray &data, const QString &mimeType,
+                        const QVector<Telegram::Peer> &peers);
+    void onAvatarMissing(const QString &fileId, const QVector<Telegram::Peer> &peers);
     void onMessageSent(const Telegram::Peer &peer, quint64 messageRandomId, quint32 messageId);
+    void onMessageActionChanged(const Telegram::Peer &peer, quint32 userId, const Telegram::MessageAction &action);
+    void onMessageReadInbox(const Telegram::Peer &peer, quint32 messageId);
+    void onMessageReadOutbox(const Telegram::Peer &peer, quint32 messageId);
+    void onChatDetailsChanged(const Telegram::Peer &peer, const Tp::UIntList &handles);
     void onContactStatusChanged(quint32 userId, Telegram::Namespace::ContactStatus status);
 
     /* Channel.Type.RoomList */
@@ -138,6 +174,32 @@ protected:
     Tp::BaseChannelPtr createRoomListChannel();
 
 private:
+    enum ContactAttributeInterface {
+        ContactAttributeContactList = 1 << 0,
+        ContactAttributeSimplePresence = 1 << 1,
+        ContactAttributeAliasing = 1 << 2,
+        ContactAttributeAvatars = 1 << 3,
+        ContactAttributeContactInfo = 1 << 4,
+    };
+
+    struct ContactAttributesCacheEntry
+    {
+        uint interfaces = 0; // ContactAttributeInterface flags
+        QVariantMap attributes;
+    };
+
+    using BacklogQueueKey = QPair<int, quint64>; // Dialog rank, sequence number
+
+    struct PendingBacklog
+    {
+        QVector<quint32> messageIds;
+        int position = 0; // The next message to deliver
+        BacklogQueueKey queueKey;
+    };
+
+    static uint getContactAttributeInterfaces(const QStringList &interfaces);
+    void invalidateContactAttributes(uint handle);
+
     uint getContactHandle(const Telegram::Peer &identifier) const;
     uint getChatHandle(const Telegram::Peer &identifier) const;
     uint addContacts(const QVector<Telegram::Peer> &identifiers);
@@ -151,6 +213,7 @@ private:
     /* Connection.Interface.Avatars */
     Tp::AvatarTokenMap getKnownAvatarTokens(const Tp::UIntList &contacts, Tp::DBusError *error);
     void requestAvatars(const Tp::UIntList &contacts, Tp::DBusError *error);
+    void fetchAvatar(uint handle, const Telegram::Peer &peer, const Telegram::FileInfo &file);
 
     /* Channel.Type.RoomList */
     void roomListStartListing(Tp::DBusError *error);
@@ -176,17 +239,32 @@ private:
     QString m_wantedPresence;
 
     QVector<quint32> m_contactList;
-    QMap<uint, Telegram::Peer> m_contactHandles;
-    QMap<uint, Telegram::Peer> m_chatHandles;
-    QHash<QString,Telegram::Peer> m_peerPictureRequests;
-
-    using SentMessageMap = QHash<quint32, quint64>; // messageId to randomMessageId
-    QHash<Telegram::Peer, SentMessageMap> m_sentMessageMap;
+    QSet<uint> m_contactListSet;
+    QHash<uint, Telegram::Namespace::ContactStatus> m_contactStatuses; // Last published presences
+    QHash<uint, ContactAttributesCacheEntry> m_contactAttributesCache;
+    MorseHandleRegistry m_contactHandles;
+    MorseHandleRegistry m_chatHandles;
+    QHash<Telegram::Peer, QPointer<MorseTextChannel>> m_textChannels; // Open text channels by the target peer
+    MorseAvatarCache *m_avatarCache = nullptr;
+    MorseAvatarScheduler *m_avatarScheduler = nullptr;
+    MorseAvatarTranscoder *m_avatarTranscoder = nullptr;
+
+    QHash<Telegram::Peer, PendingBacklog> m_backlog;
+    QMap<BacklogQueueKey, Telegram::Peer> m_backlogQueue;
+    QHash<Telegram::Peer, int> m_dialogRanks; // Position in the dialog list
+    QTimer *m_backlogTimer = nullptr;
+    MorseSyncScheduler *m_syncScheduler = nullptr;
+    bool m_dialogsSynced = false; // The history sync has been scheduled in this session
+    MorseReconnectController *m_reconnectController = nullptr;
+    bool m_networkReset = false; // The server connection is dropped locally to reconnect via a new network
+    quint64 m_backlogSequence = 0;
 
     MorseInfo *m_info = nullptr;
     Telegram::Client::AppInformation *m_appInfo = nullptr;
     Telegram::Client::Client *m_client = nullptr;
     MorseDataStorage *m_dataStorage = nullptr;
+    QSharedPointer<MorseMetrics> m_metrics; // Shared with the storage writer tasks
+    MorseMessageTracer m_messageTracer;
 
     Telegram::Client::AuthOperation *m_signOperation = nullptr;
     Telegram::Client::DialogList *m_dialogs = nullptr;
@@ -1,23 +1,116 @@
 #include "datastorage.hpp"
 #include "info.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
+#include "storagewriter.hpp"
+#include "watchdog.hpp"
 
 #include <TelegramQt/TelegramNamespace>
 
+#include <QDataStream>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QFileInfo>
 #include <QLoggingCategory>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QTimer>
 
 static const QString c_telegramStateFile = QLatin1String("telegram-state.bin");
+static const QString c_telegramStateJournalFile = QLatin1String("telegram-state.journal");
+static const QString c_sentMessagesFile = QLatin1String("sent-messages.bin");
+static const QString c_handlesFile = QLatin1String("handles.bin");
+
+static const quint32 c_handlesMagic = 0x4d534831; // MSH1
+
+static const quint32 c_sentMessagesMagic = 0x4d534d31; // MSM1
+static const int c_sentMessagesMinCompactThreshold = 1024;
+static const int c_sentMessagesWriteDelay = 1000; // ms
+
+/*
+ * The sent messages log changes waiting for the writer thread. A compaction replaces
+ * the whole file; the records added after it are appended.
+ */
+struct MorseSentMessageLog
+{
+    QMutex mutex;
+    QByteArray snapshot; // The new file content, if not null
+    QByteArray records; // Serialized records to append
+
+    // The changes taken by the task in flight, put back if the write fails
+    QByteArray writingSnapshot;
+    QByteArray writingRecords;
+};
+
+static QByteArray sentMessageRecord(const Telegram::Peer &peer, quint32 messageId, quint64 randomId)
+{
+    QByteArray record;
+    QDataStream stream(&record, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << peer.toString() << messageId << randomId;
+    return record;
+}
+
+static QByteArray sentMessagesHeader()
+{
+    QByteArray header;
+    QDataStream stream(&header, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << c_sentMessagesMagic;
+    return header;
+}
 
 MorseDataStorage::MorseDataStorage(QObject *parent) :
-    Telegram::Client::InMemoryDataStorage(parent)
+    Telegram::Client::InMemoryDataStorage(parent),
+    m_stateJournal(new MorseStateJournal()),
+    m_savedHandlesRevision(new QAtomicInteger<quint64>(0)),
+    m_sentMessagesLog(new MorseSentMessageLog())
 {
+    connect(MorseStorageWriter::instance(), &MorseStorageWriter::taskFinished,
+            this, &MorseDataStorage::onSaveTaskFinished);
 }
 
 void MorseDataStorage::setInfo(MorseInfo *info)
 {
     m_info = info;
+    updateStateFileNames();
+}
+
+void MorseDataStorage::setJournalEnabled(bool enabled)
+{
+    m_stateJournal->setJournalEnabled(enabled);
+}
+
+bool MorseDataStorage::setCompression(const QString &codecName, int level)
+{
+    MorseStateJournal::Codec codec = MorseStateJournal::CodecZlib;
+    if (!MorseStateJournal::codecFromName(codecName, &codec)) {
+        return false;
+    }
+    m_stateJournal->setCompression(codec, level);
+    return true;
+}
+
+quint64 MorseDataStorage::getSentMessageRandomId(const Telegram::Peer &peer, quint32 messageId) const
+{
+    return m_sentMessages.randomId(peer, messageId);
+}
+
+quint32 MorseDataStorage::getSentMessageId(const Telegram::Peer &peer, quint64 randomId) const
+{
+    return m_sentMessages.messageId(peer, randomId);
+}
+
+void MorseDataStorage::addSentMessage(const Telegram::Peer &peer, quint32 messageId, quint64 randomId)
+{
+    m_sentMessages.insert(peer, messageId, randomId);
+
+    if (m_sentMessagesRecords >= m_sentMessagesCompactThreshold) {
+        compactSentMessages();
+    } else {
+        appendSentMessage(peer, messageId, randomId);
+    }
 }
 
 void MorseDataStorage::scheduleSave()
@@ -36,45 +129,383 @@ void MorseDataStorage::scheduleSave()
     }
 }
 
-bool MorseDataStorage::saveData() const
+void MorseDataStorage::saveData()
 {
+    MORSE_WATCHDOG_SCOPE();
+    // The storage is not thread-safe, so the serialization is done in the main thread.
+    // The compression and the file I/O are done by the shared writer thread.
+    const QString directory = m_info->accountDataDirectory();
+    if (directory.isEmpty()) {
+        return;
+    }
+    // Do not overwrite the file with an empty state
+    ensureStateLoaded();
+
     const QByteArray data = saveState();
+    const auto maskedAccount = Telegram::Utils::maskPhoneNumber(m_info->accountIdentifier());
+    const QSharedPointer<MorseStateJournal> journal = m_stateJournal;
 
-    QDir dir;
-    dir.mkpath(m_info->accountDataDirectory());
-    QFile stateFile(m_info->accountDataDirectory() + QLatin1Char('/') + c_telegramStateFile);
+    const QSharedPointer<MorseMetrics> metrics = m_metrics;
 
-    // TODO: Save sent message ids map
+    const QSharedPointer<QElapsedTimer> timer(new QElapsedTimer());
+    const QSharedPointer<qint64> bytesWritten(new qint64(0));
 
-    if (!stateFile.open(QIODevice::WriteOnly)) {
-        qWarning() << Q_FUNC_INFO << "Unable to open state file" << stateFile.fileName();
+    // The actual result is reported via saveFinished() once the batch is synced to the disk
+    MorseStorageWriter::Task task;
+    task.prepare = [journal, data, directory, timer, bytesWritten](MorseStorageBatch *batch) {
+        timer->start();
+        QDir dir;
+        dir.mkpath(directory);
+        if (!journal->prepareSave(data, batch)) {
+            return false;
+        }
+        *bytesWritten = batch->bytesToWrite();
+        return true;
+    };
+    task.finish = [journal, data, directory, maskedAccount, timer, bytesWritten, metrics](bool succeeded) {
+        journal->finishSave(succeeded);
+        if (!succeeded) {
+            qCWarning(lcMorseStorage) << "Unable to save the session data to file"
+                       << "for account" << maskedAccount;
+            return;
+        }
+        if (metrics) {
+            metrics->increment(MorseMetrics::StateSaves);
+            metrics->increment(MorseMetrics::BytesWritten, quint64(*bytesWritten));
+            metrics->record(MorseMetrics::StateSaveDuration, *timer);
+        }
+        qCDebug(lcMorseStorage) << "State saved to" << directory
+                 << "(state" << data.size() << "bytes,"
+                 << "snapshot" << journal->storedSnapshotSize() << "bytes,"
+                 << "journal" << journal->journalSize() << "bytes,"
+                 << "codec" << journal->codec() << "level" << journal->compressionLevel() << ","
+                 << timer->elapsed() << "ms)";
+    };
+    MorseStorageWriter::instance()->enqueue(directory, task);
+
+    saveHandles();
+    if (m_sentMessagesWriteTimer && m_sentMessagesWriteTimer->isActive()) {
+        m_sentMessagesWriteTimer->stop();
+        writeSentMessages();
     }
+}
 
-    if (stateFile.write(data) != data.size()) {
-        qWarning() << Q_FUNC_INFO << "Unable to save the session data to file"
-                   << "for account"
-                   << Telegram::Utils::maskPhoneNumber(m_info->accountIdentifier());
+bool MorseDataStorage::loadData()
+{
+    MORSE_WATCHDOG_SCOPE();
+    loadHandles();
+    loadSentMessages();
+
+    // Only map the state file here; the state is decoded on the first use: on connect,
+    // before the first save, or when a client reads the roster (see ensureStateLoaded()).
+    // TelegramQt takes the state as one blob, so the whole state is decoded at once
+    // and the memory use stays linear in the stored history size.
+    m_stateLoadPending = m_stateJournal->open();
+    if (!m_stateLoadPending) {
+        qCDebug(lcMorseStorage) << Q_FUNC_INFO << "Unable to open state file" << getFilePath(c_telegramStateFile);
+        return false;
     }
-    qDebug() << Q_FUNC_INFO << "State saved to file" << stateFile.fileName();
 
+    qCDebug(lcMorseStorage) << Q_FUNC_INFO << m_info->accountIdentifier() << "(" << m_stateJournal->mappedSize() << "bytes mapped)";
     return true;
 }
 
-bool MorseDataStorage::loadData()
+bool MorseDataStorage::ensureStateLoaded()
 {
-    // TODO: Load sent message ids map
+    MORSE_WATCHDOG_SCOPE();
+    if (!m_stateLoadPending) {
+        return true;
+    }
+    m_stateLoadPending = false;
 
-    QFile stateFile(m_info->accountDataDirectory() + QLatin1Char('/') + c_telegramStateFile);
+    QElapsedTimer timer;
+    timer.start();
 
-    if (!stateFile.open(QIODevice::ReadOnly)) {
-        qDebug() << Q_FUNC_INFO << "Unable to open state file" << stateFile.fileName();
+    QByteArray data;
+    if (!m_stateJournal->load(&data)) {
         return false;
     }
 
-    const QByteArray data = stateFile.readAll();
-    qDebug() << Q_FUNC_INFO << m_info->accountIdentifier() << "(" << data.size() << "bytes)";
+    qCDebug(lcMorseStorage) << Q_FUNC_INFO << m_info->accountIdentifier() << "(" << data.size() << "bytes,"
+             << "decoded in" << timer.elapsed() << "ms)";
 
     loadState(data);
 
+    if (m_stateJournal->needsRepair()) {
+        // The load is read-only; the files are fixed by the writer thread
+        const QSharedPointer<MorseStateJournal> journal = m_stateJournal;
+        MorseStorageWriter::Task task;
+        task.prepare = [journal](MorseStorageBatch *batch) {
+            journal->prepareRepair(batch);
+            return true;
+        };
+        task.finish = [journal](bool succeeded) {
+            journal->finishRepair(succeeded);
+        };
+        // Keyed as the saves, so a save enqueued later takes the repair over (see prepareSave())
+        MorseStorageWriter::instance()->enqueue(m_info->accountDataDirectory(), task);
+    }
+
     return true;
 }
+
+void MorseDataStorage::onSaveTaskFinished(const QString &key, bool succeeded)
+{
+    if (!m_info || (key != m_info->accountDataDirectory())) {
+        return;
+    }
+    emit saveFinished(succeeded);
+}
+
+QString MorseDataStorage::getFilePath(const QString &fileName) const
+{
+    return m_info->accountDataDirectory() + QLatin1Char('/') + fileName;
+}
+
+void MorseDataStorage::updateStateFileNames()
+{
+    m_stateJournal->setSnapshotFileName(getFilePath(c_telegramStateFile));
+    m_stateJournal->setJournalFileName(getFilePath(c_telegramStateJournalFile));
+}
+
+void MorseDataStorage::setHandleRegistries(MorseHandleRegistry *contactHandles, MorseHandleRegistry *chatHandles)
+{
+    m_contactHandles = contactHandles;
+    m_chatHandles = chatHandles;
+}
+
+void MorseDataStorage::setMetrics(const QSharedPointer<MorseMetrics> &metrics)
+{
+    m_metrics = metrics;
+}
+
+/*
+ * The handle tables are persisted so a peer keeps its handle across restarts
+ * and the clients can keep handle-keyed caches.
+ */
+bool MorseDataStorage::loadHandles()
+{
+    if (!m_contactHandles || !m_chatHandles) {
+        return false;
+    }
+
+    QFile file(getFilePath(c_handlesFile));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic = 0;
+    QStringList contacts;
+    QStringList chats;
+    stream >> magic >> contacts >> chats;
+    if ((stream.status() != QDataStream::Ok) || (magic != c_handlesMagic)) {
+        qCWarning(lcMorseStorage) << Q_FUNC_INFO << "Unable to read handles file" << file.fileName();
+        return false;
+    }
+
+    m_contactHandles->fromStringList(contacts);
+    m_chatHandles->fromStringList(chats);
+    m_savedHandlesRevision->storeRelease(handlesRevision());
+
+    qCDebug(lcMorseStorage) << Q_FUNC_INFO << contacts.count() << "contact handles," << chats.count() << "chat handles";
+    return true;
+}
+
+void MorseDataStorage::saveHandles()
+{
+    if (!m_contactHandles || !m_chatHandles) {
+        return;
+    }
+    const quint64 revision = handlesRevision();
+    if (revision == m_savedHandlesRevision->loadAcquire()) {
+        return;
+    }
+
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << c_handlesMagic << m_contactHandles->toStringList() << m_chatHandles->toStringList();
+
+    const QString directory = m_info->accountDataDirectory();
+    const QString fileName = getFilePath(c_handlesFile);
+    MorseStorageWriter::Task task;
+    task.prepare = [directory, fileName, data](MorseStorageBatch *batch) {
+        QDir dir;
+        dir.mkpath(directory);
+        batch->replaceFile(fileName, data);
+        return true;
+    };
+    const QSharedPointer<QAtomicInteger<quint64>> savedRevision = m_savedHandlesRevision;
+    task.finish = [savedRevision, revision](bool succeeded) {
+        // The tables stay dirty (and are saved again with the next state) if the write failed
+        if (succeeded) {
+            savedRevision->storeRelease(revision);
+        }
+    };
+    MorseStorageWriter::instance()->enqueue(fileName, task);
+}
+
+quint64 MorseDataStorage::handlesRevision() const
+{
+    // Both revisions only grow, so the sum changes with any of them
+    return m_contactHandles->revision() + m_chatHandles->revision();
+}
+
+bool MorseDataStorage::loadSentMessages()
+{
+    m_sentMessages.clear();
+    m_sentMessagesRecords = 0;
+
+    QFile file(getFilePath(c_sentMessagesFile));
+    if (!file.open(QIODevice::ReadOnly)) {
+        m_sentMessagesCompactThreshold = c_sentMessagesMinCompactThreshold;
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic = 0;
+    stream >> magic;
+    if (magic != c_sentMessagesMagic) {
+        qCWarning(lcMorseStorage) << Q_FUNC_INFO << "Unknown sent messages file format" << file.fileName();
+        return compactSentMessages();
+    }
+
+    int records = 0;
+    while (!stream.atEnd()) {
+        QString peerString;
+        quint32 messageId = 0;
+        quint64 randomId = 0;
+        stream >> peerString >> messageId >> randomId;
+        if (stream.status() != QDataStream::Ok) {
+            // A truncated record at the end of the log (e.g. the process was killed while writing)
+            qCWarning(lcMorseStorage) << Q_FUNC_INFO << "Ignore the truncated tail of" << file.fileName();
+            break;
+        }
+        const Telegram::Peer peer = Telegram::Peer::fromString(peerString);
+        if (!peer.isValid()) {
+            continue;
+        }
+        m_sentMessages.insert(peer, messageId, randomId);
+        ++records;
+    }
+    file.close();
+
+    const int count = m_sentMessages.count();
+    qCDebug(lcMorseStorage) << Q_FUNC_INFO << count << "sent messages (" << records << "records)";
+
+    // Drop the evicted and overwritten records
+    if ((records > count * 2) || (stream.status() != QDataStream::Ok)) {
+        return compactSentMessages();
+    }
+
+    m_sentMessagesRecords = records;
+    m_sentMessagesCompactThreshold = qMax(count * 2, c_sentMessagesMinCompactThreshold);
+    return true;
+}
+
+bool MorseDataStorage::compactSentMessages()
+{
+    QByteArray snapshot = sentMessagesHeader();
+    int records = 0;
+    m_sentMessages.forEach([&snapshot, &records](const Telegram::Peer &peer, quint32 messageId, quint64 randomId) {
+        snapshot += sentMessageRecord(peer, messageId, randomId);
+        ++records;
+    });
+
+    {
+        QMutexLocker locker(&m_sentMessagesLog->mutex);
+        // The pending records are in the snapshot already
+        m_sentMessagesLog->snapshot = snapshot;
+        m_sentMessagesLog->records.clear();
+    }
+    scheduleSentMessagesWrite();
+
+    m_sentMessagesRecords = records;
+    m_sentMessagesCompactThreshold = qMax(records * 2, c_sentMessagesMinCompactThreshold);
+    return true;
+}
+
+bool MorseDataStorage::appendSentMessage(const Telegram::Peer &peer, quint32 messageId, quint64 randomId)
+{
+    {
+        QMutexLocker locker(&m_sentMessagesLog->mutex);
+        m_sentMessagesLog->records += sentMessageRecord(peer, messageId, randomId);
+    }
+    scheduleSentMessagesWrite();
+    ++m_sentMessagesRecords;
+    return true;
+}
+
+/*
+ * The sent messages are written with a short delay, so a burst of messages
+ * costs one append and one sync instead of one per message.
+ */
+void MorseDataStorage::scheduleSentMessagesWrite()
+{
+    if (!m_sentMessagesWriteTimer) {
+        m_sentMessagesWriteTimer = new QTimer(this);
+        m_sentMessagesWriteTimer->setSingleShot(true);
+        m_sentMessagesWriteTimer->setInterval(c_sentMessagesWriteDelay);
+        connect(m_sentMessagesWriteTimer, &QTimer::timeout, this, &MorseDataStorage::writeSentMessages);
+    }
+
+    // Do not restart the timer to not postpone the write indefinitely
+    if (!m_sentMessagesWriteTimer->isActive()) {
+        m_sentMessagesWriteTimer->start();
+    }
+}
+
+void MorseDataStorage::writeSentMessages()
+{
+    const QString directory = m_info->accountDataDirectory();
+    if (directory.isEmpty()) {
+        return;
+    }
+    const QString fileName = getFilePath(c_sentMessagesFile);
+    const QSharedPointer<MorseSentMessageLog> log = m_sentMessagesLog;
+
+    // A pending task of the log takes all the changes, so the coalescing loses nothing
+    MorseStorageWriter::Task task;
+    task.prepare = [log, directory, fileName](MorseStorageBatch *batch) {
+        QByteArray snapshot;
+        QByteArray records;
+        {
+            QMutexLocker locker(&log->mutex);
+            snapshot.swap(log->snapshot);
+            records.swap(log->records);
+            log->writingSnapshot = snapshot;
+            log->writingRecords = records;
+        }
+        QDir dir;
+        dir.mkpath(directory);
+        if (!snapshot.isNull()) {
+            batch->replaceFile(fileName, snapshot + records);
+        } else if (!records.isEmpty()) {
+            if (QFileInfo(fileName).size() == 0) {
+                batch->appendFile(fileName, sentMessagesHeader() + records);
+            } else {
+                batch->appendFile(fileName, records);
+            }
+        }
+        return true;
+    };
+    task.finish = [log, fileName](bool succeeded) {
+        QMutexLocker locker(&log->mutex);
+        if (!succeeded) {
+            qCWarning(lcMorseStorage) << "Unable to write" << fileName;
+            // Put the changes back for the next write; a newer compaction already includes them
+            if (log->snapshot.isNull()) {
+                log->snapshot = log->writingSnapshot;
+                log->records.prepend(log->writingRecords);
+            }
+        }
+        log->writingSnapshot = QByteArray();
+        log->writingRecords = QByteArray();
+    };
+    MorseStorageWriter::instance()->enqueue(fileName, task);
+}
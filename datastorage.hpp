@@ -3,9 +3,18 @@
 
 #include <TelegramQt/DataStorage>
 
+#include <QAtomicInteger>
+#include <QSharedPointer>
+
+#include "handleregistry.hpp"
+#include "sentmessagemap.hpp"
+#include "statejournal.hpp"
+
 QT_FORWARD_DECLARE_CLASS(QTimer)
 
 class MorseInfo;
+class MorseMetrics;
+struct MorseSentMessageLog;
 
 class MorseDataStorage : public Telegram::Client::InMemoryDataStorage
 {
@@ -14,16 +23,62 @@ public:
     explicit MorseDataStorage(QObject *parent = nullptr);
 
     void setInfo(MorseInfo *info);
+    void setJournalEnabled(bool enabled);
+    bool setCompression(const QString &codecName, int level);
+
+    quint64 getSentMessageRandomId(const Telegram::Peer &peer, quint32 messageId) const;
+    quint32 getSentMessageId(const Telegram::Peer &peer, quint64 randomId) const;
+    void addSentMessage(const Telegram::Peer &peer, quint32 messageId, quint64 randomId);
+
+    bool ensureStateLoaded();
+
+    void setHandleRegistries(MorseHandleRegistry *contactHandles, MorseHandleRegistry *chatHandles);
+    void setMetrics(const QSharedPointer<MorseMetrics> &metrics);
 
 public slots:
     void scheduleSave();
-    bool saveData() const;
+    // Queues the save; the result is reported via saveFinished()
+    void saveData();
     bool loadData();
 
+signals:
+    void saveFinished(bool succeeded);
+
+protected slots:
+    void onSaveTaskFinished(const QString &key, bool succeeded);
+
 protected:
+    QString getFilePath(const QString &fileName) const;
+    void updateStateFileNames();
+
+    bool loadHandles();
+    void saveHandles();
+    quint64 handlesRevision() const;
+
+    bool loadSentMessages();
+    bool compactSentMessages();
+    bool appendSentMessage(const Telegram::Peer &peer, quint32 messageId, quint64 randomId);
+    void scheduleSentMessagesWrite();
+    void writeSentMessages();
+
     MorseInfo *m_info = nullptr;
     QTimer *m_delayedSaveTimer = nullptr;
 
+    QSharedPointer<MorseStateJournal> m_stateJournal; // Shared with the pending writer tasks
+    bool m_stateLoadPending = false; // The state file is mapped, but not decoded yet
+    QSharedPointer<MorseMetrics> m_metrics; // Updated by the writer thread
+
+    MorseHandleRegistry *m_contactHandles = nullptr;
+    MorseHandleRegistry *m_chatHandles = nullptr;
+    // The revision of the handle tables in the file; the tables are dirty if it differs
+    QSharedPointer<QAtomicInteger<quint64>> m_savedHandlesRevision; // Updated by the writer thread
+
+    MorseSentMessageMap m_sentMessages;
+    QSharedPointer<MorseSentMessageLog> m_sentMessagesLog; // Append-only log, compacted on load
+    int m_sentMessagesRecords = 0;
+    int m_sentMessagesCompactThreshold = 0;
+    QTimer *m_sentMessagesWriteTimer = nullptr;
+
 };
 
 #endif // MORSE_DATA_STORAGE
@@ -18,8 +18,17 @@
 */
 
 #include "debug.hpp"
+#include "logging.hpp"
+#include "watchdog.hpp"
 
 #include <TelepathyQt/BaseDebug>
+#include <TelepathyQt/Callbacks>
+
+#include <QDBusAbstractAdaptor>
+#include <QDateTime>
+#include <QEvent>
+#include <QMutex>
+#include <QVector>
 
 #if TP_QT_VERSION < TP_QT_VERSION_CHECK(0, 9, 8)
 class FixedBaseDebug : public Tp::BaseDebug
@@ -47,58 +56,203 @@ static QPointer<FixedBaseDebug> debugInterfacePtr;
 static QPointer<Tp::BaseDebug> debugInterfacePtr;
 #endif
 
+// Morse extension of the debug object
+class MorseDebugAdaptor : public QDBusAbstractAdaptor
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.freedesktop.Telepathy.Morse.Debug")
+public:
+    explicit MorseDebugAdaptor(QObject *parent) :
+        QDBusAbstractAdaptor(parent)
+    {
+    }
+
+public slots:
+    // Recent main loop stalls (oldest first) as a{sv} with timestamp, duration (ms) and scope
+    QVariantList GetStalls()
+    {
+        if (!MorseWatchdog::instance()) {
+            return QVariantList();
+        }
+        return MorseWatchdog::instance()->recentStallsToVariantList();
+    }
+};
+
+// BaseDebug does not notify about the Enabled property changes. The D-Bus calls to the debug
+// object (the property Set included) are delivered to it as meta-call events, so re-read
+// the property after each call to enable the morse categories while a client listens.
+class MorseDebugEnabledWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MorseDebugEnabledWatcher(QObject *dbusObject) :
+        QObject(dbusObject)
+    {
+        dbusObject->installEventFilter(this);
+    }
+
+    bool eventFilter(QObject *watched, QEvent *event) override
+    {
+        if (event->type() == QEvent::MetaCall) {
+            // The call is not handled yet
+            QMetaObject::invokeMethod(this, "updateEnabled", Qt::QueuedConnection);
+        }
+        return QObject::eventFilter(watched, event);
+    }
+
+public slots:
+    void updateEnabled();
+};
+
 #if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
 bool enableDebugInterface() { return false; }
 #else
 
 static QtMessageHandler defaultMessageHandler = 0;
 
-void debugViaDBusInterface(QtMsgType type, const QMessageLogContext &context, const QString &msg)
+static const int c_debugMessagesLimit = 1000; // Records kept for GetMessages
+
+// The context strings are copied: a message from a plugin may outlive its literals.
+// The message itself is formatted only when a debug client asks for it.
+struct DebugRecord
 {
-    if (!debugInterfacePtr.isNull()) {
-        QString domain(QLatin1String("%1:%2, %3"));
-        QByteArray fileName = QByteArray::fromRawData(context.file, qstrlen(context.file));
-
-        static const char *namesToWrap[] = {
-            "morse",
-            "telepathy-qt"
-        };
-
-        for (int i = 0; i < 2; ++i) {
-            int index = fileName.indexOf(namesToWrap[i]);
-            if (index < 0) {
-                continue;
-            }
-
-            fileName = fileName.mid(index);
-            break;
+    qint64 timestamp = 0; // ms since epoch
+    QtMsgType type = QtDebugMsg;
+    QByteArray category;
+    QByteArray file;
+    QByteArray function;
+    int line = 0;
+    QString message;
+
+    void setContext(const QMessageLogContext &context)
+    {
+        category = context.category;
+        file = context.file;
+        function = context.function;
+        line = context.line;
+    }
+};
+
+class DebugRingBuffer
+{
+public:
+    DebugRingBuffer()
+    {
+        m_records.resize(c_debugMessagesLimit);
+    }
+
+    void append(QtMsgType type, const QMessageLogContext &context, const QString &message)
+    {
+        QMutexLocker locker(&m_lock);
+        DebugRecord &record = m_records[m_next];
+        record.timestamp = QDateTime::currentMSecsSinceEpoch();
+        record.type = type;
+        record.setContext(context);
+        record.message = message;
+        m_next = (m_next + 1) % m_records.count();
+        m_count = qMin(m_count + 1, m_records.count());
+    }
+
+    QVector<DebugRecord> records() const
+    {
+        QMutexLocker locker(&m_lock);
+        QVector<DebugRecord> result;
+        result.reserve(m_count);
+        const int first = (m_next - m_count + m_records.count()) % m_records.count();
+        for (int i = 0; i < m_count; ++i) {
+            result.append(m_records.at((first + i) % m_records.count()));
         }
+        return result;
+    }
+
+protected:
+    mutable QMutex m_lock;
+    QVector<DebugRecord> m_records;
+    int m_next = 0;
+    int m_count = 0;
+};
 
-        domain = domain.arg(QString::fromLocal8Bit(fileName)).arg(context.line).arg(QString::fromLatin1(context.function));
-        QString message = msg;
-        if (message.startsWith(QLatin1String(context.function))) {
-            message = message.mid(qstrlen(context.function));
-            if (message.startsWith(QLatin1Char(' '))) {
-                message.remove(0, 1);
-            }
+static DebugRingBuffer debugRingBuffer;
+
+static QString formatDomain(const DebugRecord &record)
+{
+    QByteArray fileName = record.file;
+
+    static const char *namesToWrap[] = {
+        "morse",
+        "telepathy-qt"
+    };
+
+    for (int i = 0; i < 2; ++i) {
+        int index = fileName.indexOf(namesToWrap[i]);
+        if (index < 0) {
+            continue;
         }
 
-        switch (type) {
-        case QtDebugMsg:
-            debugInterfacePtr->newDebugMessage(domain, Tp::DebugLevelDebug, message);
-            break;
-        case QtInfoMsg:
-            debugInterfacePtr->newDebugMessage(domain, Tp::DebugLevelInfo, message);
-            break;
-        case QtWarningMsg:
-            debugInterfacePtr->newDebugMessage(domain, Tp::DebugLevelWarning, message);
-            break;
-        case QtCriticalMsg:
-            debugInterfacePtr->newDebugMessage(domain, Tp::DebugLevelCritical, message);
-            break;
-        case QtFatalMsg:
-            debugInterfacePtr->newDebugMessage(domain, Tp::DebugLevelError, message);
-            break;
+        fileName = fileName.mid(index);
+        break;
+    }
+
+    QString domain(QLatin1String("%1:%2, %3"));
+    return domain.arg(QString::fromLocal8Bit(fileName)).arg(record.line).arg(QString::fromLatin1(record.function));
+}
+
+static Tp::DebugLevel debugLevel(QtMsgType type)
+{
+    switch (type) {
+    case QtDebugMsg:
+        return Tp::DebugLevelDebug;
+    case QtInfoMsg:
+        return Tp::DebugLevelInfo;
+    case QtWarningMsg:
+        return Tp::DebugLevelWarning;
+    case QtCriticalMsg:
+        return Tp::DebugLevelCritical;
+    case QtFatalMsg:
+        return Tp::DebugLevelError;
+    }
+    return Tp::DebugLevelDebug;
+}
+
+static Tp::DebugMessage formatRecord(const DebugRecord &record)
+{
+    Tp::DebugMessage result;
+    result.timestamp = record.timestamp / 1000.0;
+    result.domain = formatDomain(record);
+    result.level = debugLevel(record.type);
+    result.message = record.message;
+    if (!record.function.isEmpty() && result.message.startsWith(QLatin1String(record.function))) {
+        result.message = result.message.mid(record.function.size());
+        if (result.message.startsWith(QLatin1Char(' '))) {
+            result.message.remove(0, 1);
+        }
+    }
+    return result;
+}
+
+static Tp::DebugMessageList getDebugMessages(Tp::DBusError *error)
+{
+    Q_UNUSED(error)
+    Tp::DebugMessageList messages;
+    for (const DebugRecord &record : debugRingBuffer.records()) {
+        messages.append(formatRecord(record));
+    }
+    return messages;
+}
+
+void debugViaDBusInterface(QtMsgType type, const QMessageLogContext &context, const QString &msg)
+{
+    if (!debugInterfacePtr.isNull()) {
+        debugRingBuffer.append(type, context, msg);
+
+        // Format the message only if a client is subscribed to the signal
+        if (debugInterfacePtr->isEnabled()) {
+            DebugRecord record;
+            record.type = type;
+            record.setContext(context);
+            record.message = msg;
+            const Tp::DebugMessage message = formatRecord(record);
+            debugInterfacePtr->newDebugMessage(message.domain, debugLevel(type), message.message);
         }
     }
 
@@ -133,17 +287,26 @@ bool enableDebugInterface()
     debugInterfacePtr = new Tp::BaseDebug();
 #endif
 
-    debugInterfacePtr->setGetMessagesLimit(-1);
+    // BaseDebug keeps formatted messages; keep the raw records in the ring buffer instead
+    debugInterfacePtr->setGetMessagesLimit(0);
+    debugInterfacePtr->setGetMessagesCallback(Tp::ptrFun(&getDebugMessages));
+
+    (void) new MorseDebugAdaptor(debugInterfacePtr->dbusObject());
 
     if (!debugInterfacePtr->registerObject(TP_QT_CONNECTION_MANAGER_BUS_NAME_BASE + QLatin1String("morse"))) {
         return false;
     }
 
     defaultMessageHandler = qInstallMessageHandler(debugViaDBusInterface);
+
+    (void) new MorseDebugEnabledWatcher(debugInterfacePtr->dbusObject());
     return true;
 }
 #endif
 
-#if TP_QT_VERSION < TP_QT_VERSION_CHECK(0, 9, 8)
+void MorseDebugEnabledWatcher::updateEnabled()
+{
+    setDebugLoggingEnabled(!debugInterfacePtr.isNull() && debugInterfacePtr->isEnabled());
+}
+
 #include "debug.moc"
-#endif
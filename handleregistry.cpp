@@ -0,0 +1,122 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "handleregistry.hpp"
+
+Telegram::Peer MorseHandleRegistry::peer(uint handle) const
+{
+    if (!contains(handle)) {
+        return Telegram::Peer();
+    }
+    return m_peers.at(static_cast<int>(handle - 1));
+}
+
+/**
+ * Return the handle of the \a peer, allocating a new one if the peer is not known yet.
+ *
+ * \return the handle or 0 if the peer is not valid
+ */
+uint MorseHandleRegistry::ensureHandle(const Telegram::Peer &peer)
+{
+    if (!peer.isValid()) {
+        return 0;
+    }
+
+    uint handle = m_handles.value(peer, 0);
+    if (handle) {
+        return handle;
+    }
+
+    m_peers.append(peer);
+    handle = lastHandle();
+    m_handles.insert(peer, handle);
+    ++m_revision;
+    return handle;
+}
+
+/**
+ * Bind the \a handle to the \a peer.
+ *
+ * This is needed for the handles reserved in advance (e.g. the self handle, which is
+ * allocated before the self user id is known). The table grows as needed and the gaps
+ * are filled with invalid peers.
+ */
+void MorseHandleRegistry::setPeer(uint handle, const Telegram::Peer &peer)
+{
+    if (!handle) {
+        return;
+    }
+
+    if (handle > lastHandle()) {
+        m_peers.resize(static_cast<int>(handle));
+    }
+
+    Telegram::Peer &slot = m_peers[static_cast<int>(handle - 1)];
+    if (slot.isValid() && (m_handles.value(slot) == handle)) {
+        m_handles.remove(slot);
+    }
+    slot = peer;
+
+    if (peer.isValid()) {
+        m_handles.insert(peer, handle);
+    }
+    ++m_revision;
+}
+
+void MorseHandleRegistry::clear()
+{
+    m_peers.clear();
+    m_handles.clear();
+    ++m_revision;
+}
+
+void MorseHandleRegistry::reserve(int size)
+{
+    m_peers.reserve(size);
+    m_handles.reserve(size);
+}
+
+/**
+ * Serialize the table; the list index is the handle - 1 and the gaps are empty strings.
+ */
+QStringList MorseHandleRegistry::toStringList() const
+{
+    QStringList result;
+    result.reserve(m_peers.count());
+    for (const Telegram::Peer &peer : m_peers) {
+        result.append(peer.isValid() ? peer.toString() : QString());
+    }
+    return result;
+}
+
+void MorseHandleRegistry::fromStringList(const QStringList &peers)
+{
+    clear();
+    reserve(peers.count());
+    for (int i = 0; i < peers.count(); ++i) {
+        const Telegram::Peer peer = Telegram::Peer::fromString(peers.at(i));
+        if (m_handles.contains(peer)) {
+            // Keep the first handle of a duplicated peer and leave a gap
+            m_peers.append(Telegram::Peer());
+            ++m_revision;
+            continue;
+        }
+        setPeer(static_cast<uint>(i + 1), peer);
+    }
+}
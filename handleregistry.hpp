@@ -0,0 +1,64 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MORSE_HANDLE_REGISTRY_HPP
+#define MORSE_HANDLE_REGISTRY_HPP
+
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+
+#include <TelegramQt/TelegramNamespace>
+
+/**
+ * Bidirectional handle <-> peer table.
+ *
+ * Handles are allocated sequentially starting from 1, so the handle -> peer direction is
+ * a plain vector index and the peer -> handle direction is a hash lookup.
+ * Handles are never released during the connection lifetime. revision() changes on every
+ * modification of the table, so the users can tell whether it needs to be saved.
+ */
+class MorseHandleRegistry
+{
+public:
+    bool isEmpty() const { return m_peers.isEmpty(); }
+    int count() const { return m_peers.count(); }
+    uint lastHandle() const { return static_cast<uint>(m_peers.count()); }
+    quint64 revision() const { return m_revision; }
+
+    bool contains(uint handle) const { return handle && (handle <= lastHandle()); }
+    uint handle(const Telegram::Peer &peer) const { return m_handles.value(peer, 0); }
+    Telegram::Peer peer(uint handle) const;
+
+    uint ensureHandle(const Telegram::Peer &peer);
+    void setPeer(uint handle, const Telegram::Peer &peer);
+
+    void clear();
+    void reserve(int size);
+
+    QStringList toStringList() const;
+    void fromStringList(const QStringList &peers);
+
+protected:
+    QVector<Telegram::Peer> m_peers; // m_peers[handle - 1]
+    QHash<Telegram::Peer, uint> m_handles;
+    quint64 m_revision = 0;
+};
+
+#endif // MORSE_HANDLE_REGISTRY_HPP
@@ -0,0 +1,83 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "logging.hpp"
+
+#include <TelepathyQt/Debug>
+
+#include <QStringList>
+
+Q_LOGGING_CATEGORY(lcMorseConnection, "morse.connection", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcMorseStorage, "morse.storage", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcMorseChannel, "morse.channel", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcMorseAvatars, "morse.avatars", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcMorseAuth, "morse.auth", QtWarningMsg)
+
+static const char *c_subsystems[] = {
+    "connection",
+    "storage",
+    "channel",
+    "avatars",
+    "auth",
+};
+
+static QStringList s_environmentSubsystems; // Enabled via MORSE_DEBUG
+static bool s_debugLoggingEnabled = false; // Enabled via the debug interface
+
+static void applyLoggingRules()
+{
+    const bool all = s_debugLoggingEnabled
+            || s_environmentSubsystems.contains(QLatin1String("all"))
+            || s_environmentSubsystems.contains(QLatin1String("1"));
+
+    QStringList rules;
+    for (const char *subsystem : c_subsystems) {
+        if (!all && !s_environmentSubsystems.contains(QLatin1String(subsystem))) {
+            continue;
+        }
+        rules.append(QLatin1String("morse.") + QLatin1String(subsystem) + QLatin1String(".debug=true"));
+        rules.append(QLatin1String("morse.") + QLatin1String(subsystem) + QLatin1String(".info=true"));
+    }
+    QLoggingCategory::setFilterRules(rules.join(QLatin1Char('\n')));
+
+    Tp::enableDebug(all || s_environmentSubsystems.contains(QLatin1String("telepathy")));
+}
+
+void setupLoggingCategories()
+{
+    const QString value = QString::fromLocal8Bit(qgetenv("MORSE_DEBUG")).toLower();
+    s_environmentSubsystems.clear();
+    // Skip the empty parts by hand: QString::SkipEmptyParts is deprecated since Qt 5.14
+    for (const QString &part : value.split(QLatin1Char(','))) {
+        const QString subsystem = part.trimmed();
+        if (!subsystem.isEmpty()) {
+            s_environmentSubsystems.append(subsystem);
+        }
+    }
+    applyLoggingRules();
+}
+
+void setDebugLoggingEnabled(bool enabled)
+{
+    if (s_debugLoggingEnabled == enabled) {
+        return;
+    }
+    s_debugLoggingEnabled = enabled;
+    applyLoggingRules();
+}
@@ -0,0 +1,43 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MORSE_LOGGING_HPP
+#define MORSE_LOGGING_HPP
+
+#include <QLoggingCategory>
+
+/**
+ * Logging categories of the morse subsystems.
+ *
+ * The debug and info messages are disabled by default; qCDebug() does not evaluate
+ * the message arguments of a disabled category. MORSE_DEBUG enables the categories
+ * at startup, e.g. MORSE_DEBUG=connection,storage or MORSE_DEBUG=all ("telepathy" enables
+ * the TelepathyQt debug output). The Telepathy debug interface enables all of them
+ * while a client listens. QT_LOGGING_RULES takes precedence over both.
+ */
+Q_DECLARE_LOGGING_CATEGORY(lcMorseConnection)
+Q_DECLARE_LOGGING_CATEGORY(lcMorseStorage)
+Q_DECLARE_LOGGING_CATEGORY(lcMorseChannel)
+Q_DECLARE_LOGGING_CATEGORY(lcMorseAvatars)
+Q_DECLARE_LOGGING_CATEGORY(lcMorseAuth)
+
+void setupLoggingCategories();
+void setDebugLoggingEnabled(bool enabled);
+
+#endif // MORSE_LOGGING_HPP
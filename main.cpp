@@ -26,7 +26,9 @@
 #include <TelegramQt/TelegramNamespace>
 
 #include "info.hpp"
+#include "logging.hpp"
 #include "protocol.hpp"
+#include "watchdog.hpp"
 
 #ifdef ENABLE_DEBUG_IFACE
 #include "debug.hpp"
@@ -43,11 +45,13 @@ int main(int argc, char *argv[])
 
     Telegram::initialize();
     Tp::registerTypes();
-    Tp::enableDebug(true);
+    setupLoggingCategories();
     Tp::enableWarnings(true);
 #ifdef ENABLE_DEBUG_IFACE
     enableDebugInterface();
 #endif
+    // Opt-in main loop stall detection, e.g. MORSE_WATCHDOG=500 (the threshold in ms)
+    MorseWatchdog::enable(qEnvironmentVariableIntValue("MORSE_WATCHDOG"));
 
     Tp::BaseProtocolPtr proto = Tp::BaseProtocol::create<MorseProtocol>(QLatin1String("telegram"));
     Tp::BaseConnectionManagerPtr cm = Tp::BaseConnectionManager::create(QLatin1String("morse"));
@@ -0,0 +1,230 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "messagetracer.hpp"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+static const int c_mainLoopTid = 1;
+static const int c_networkTid = 2;
+
+MorseMessageTracer::MorseMessageTracer(int capacity) :
+    m_capacity(qMax(1, capacity))
+{
+}
+
+void MorseMessageTracer::setEnabled(bool enabled)
+{
+    if (m_enabled == enabled) {
+        return;
+    }
+    m_enabled = enabled;
+    m_current = nullptr;
+    m_queued.clear();
+    if (enabled) {
+        m_records.resize(m_capacity);
+        m_clock.start();
+        m_epochOffset = QDateTime::currentMSecsSinceEpoch() * 1000;
+    }
+}
+
+qint64 MorseMessageTracer::now() const
+{
+    return m_epochOffset + m_clock.nsecsElapsed() / 1000;
+}
+
+void MorseMessageTracer::begin(const Telegram::Peer &peer, quint32 messageId)
+{
+    if (!m_enabled) {
+        return;
+    }
+    m_currentRecord.peer = peer;
+    m_currentRecord.messageId = messageId;
+    m_currentRecord.serverDate = 0;
+    for (qint64 &stamp : m_currentRecord.stamps) {
+        stamp = 0;
+    }
+    m_current = &m_currentRecord;
+    m_current->stamps[StageUpdate] = now();
+}
+
+void MorseMessageTracer::setServerDate(quint32 date)
+{
+    if (m_current) {
+        m_current->serverDate = date;
+    }
+}
+
+void MorseMessageTracer::finish()
+{
+    if (!m_current) {
+        return;
+    }
+    m_current->stamps[StageDone] = now();
+    m_records[m_next] = *m_current;
+    m_next = (m_next + 1) % m_capacity;
+    m_count = qMin(m_count + 1, m_capacity);
+    m_current = nullptr;
+}
+
+void MorseMessageTracer::discard()
+{
+    m_current = nullptr;
+}
+
+void MorseMessageTracer::clear()
+{
+    m_next = 0;
+    m_count = 0;
+}
+
+/**
+ * Park the open record until the message is delivered, see resume().
+ */
+void MorseMessageTracer::queue()
+{
+    if (!m_current) {
+        return;
+    }
+    m_current->stamps[StageQueued] = now();
+    if (m_queued.count() < m_capacity) {
+        m_queued.insert(RecordKey(m_current->peer, m_current->messageId), *m_current);
+    }
+    m_current = nullptr;
+}
+
+/**
+ * Reopen the record parked by queue() for the message, if any.
+ */
+bool MorseMessageTracer::resume(const Telegram::Peer &peer, quint32 messageId)
+{
+    if (m_queued.isEmpty()) {
+        return false;
+    }
+    const auto it = m_queued.find(RecordKey(peer, messageId));
+    if (it == m_queued.end()) {
+        return false;
+    }
+    m_currentRecord = it.value();
+    m_queued.erase(it);
+    m_current = &m_currentRecord;
+    return true;
+}
+
+void MorseMessageTracer::clearQueued()
+{
+    m_queued.clear();
+}
+
+QByteArray MorseMessageTracer::toChromeTrace() const
+{
+    const qint64 pid = QCoreApplication::applicationPid();
+    QJsonArray events;
+
+    const auto threadName = [pid](int tid, const QString &name) {
+        QJsonObject event;
+        event.insert(QLatin1String("name"), QLatin1String("thread_name"));
+        event.insert(QLatin1String("ph"), QLatin1String("M"));
+        event.insert(QLatin1String("pid"), pid);
+        event.insert(QLatin1String("tid"), tid);
+        event.insert(QLatin1String("args"), QJsonObject({{QLatin1String("name"), name}}));
+        return event;
+    };
+    events.append(threadName(c_mainLoopTid, QLatin1String("morse")));
+    events.append(threadName(c_networkTid, QLatin1String("server to update (1 s precision)")));
+
+    const int first = (m_next - m_count + m_capacity) % m_capacity;
+    for (int i = 0; i < m_count; ++i) {
+        const Record &record = m_records.at((first + i) % m_capacity);
+        const QJsonObject args({
+                                   {QLatin1String("peer"), record.peer.toString()},
+                                   {QLatin1String("message"), qint64(record.messageId)},
+                               });
+
+        // The server date has the second precision, so the network part is only an estimate
+        const qint64 serverStamp = qint64(record.serverDate) * 1000000;
+        if (record.serverDate && (serverStamp <= record.stamps[StageUpdate])) {
+            QJsonObject event;
+            event.insert(QLatin1String("name"), QLatin1String("network"));
+            event.insert(QLatin1String("cat"), QLatin1String("telegram"));
+            event.insert(QLatin1String("ph"), QLatin1String("X"));
+            event.insert(QLatin1String("ts"), double(serverStamp));
+            event.insert(QLatin1String("dur"), double(record.stamps[StageUpdate] - serverStamp));
+            event.insert(QLatin1String("pid"), pid);
+            event.insert(QLatin1String("tid"), c_networkTid);
+            event.insert(QLatin1String("args"), args);
+            events.append(event);
+        }
+
+        // Each stage lasts until the next stamped one
+        int stage = StageUpdate;
+        while (stage < StageDone) {
+            int next = stage + 1;
+            while ((next < StageDone) && !record.stamps[next]) {
+                ++next;
+            }
+            if (record.stamps[stage] && record.stamps[next]) {
+                QJsonObject event;
+                event.insert(QLatin1String("name"), QLatin1String(stageName(Stage(stage))));
+                event.insert(QLatin1String("cat"), QLatin1String("morse"));
+                event.insert(QLatin1String("ph"), QLatin1String("X"));
+                event.insert(QLatin1String("ts"), double(record.stamps[stage]));
+                event.insert(QLatin1String("dur"), double(record.stamps[next] - record.stamps[stage]));
+                event.insert(QLatin1String("pid"), pid);
+                event.insert(QLatin1String("tid"), c_mainLoopTid);
+                event.insert(QLatin1String("args"), args);
+                events.append(event);
+            }
+            stage = next;
+        }
+    }
+
+    QJsonObject trace;
+    trace.insert(QLatin1String("traceEvents"), events);
+    trace.insert(QLatin1String("displayTimeUnit"), QLatin1String("ms"));
+    return QJsonDocument(trace).toJson(QJsonDocument::Compact);
+}
+
+const char *MorseMessageTracer::stageName(Stage stage)
+{
+    switch (stage) {
+    case StageUpdate:
+        return "update";
+    case StageQueued:
+        return "queued";
+    case StageEnsureChannel:
+        return "ensureTextChannel";
+    case StageGetMessage:
+        return "getMessage";
+    case StageBuildParts:
+        return "buildParts";
+    case StageMediaInfo:
+        return "getMessageMediaInfo";
+    case StageAddReceivedMessage:
+        return "addReceivedMessage";
+    case StageDone:
+    case StageCount:
+        break;
+    }
+    return "";
+}
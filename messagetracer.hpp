@@ -0,0 +1,113 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MORSE_MESSAGE_TRACER_HPP
+#define MORSE_MESSAGE_TRACER_HPP
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QPair>
+#include <QVector>
+
+#include <TelegramQt/TelegramNamespace>
+
+/**
+ * Per-stage timestamps of the incoming messages.
+ *
+ * The delivery of a new message is synchronous, so a single record is open at a time:
+ * begin() opens it, stamp() marks the start of the next stage and finish() closes it into
+ * a ring buffer of the last capacity() messages. A message which waits for the history
+ * backlog of its peer is parked with queue() and its record is reopened by resume(). While the tracing is disabled no record
+ * is open and a stamp() is a single pointer check. The records are exported as Chrome
+ * trace-event JSON (chrome://tracing, Perfetto).
+ *
+ * Not thread-safe; used by the main thread only.
+ */
+class MorseMessageTracer
+{
+public:
+    enum Stage {
+        StageUpdate, // TelegramQt messageReceived update
+        StageQueued, // Waiting for the backlog of the peer
+        StageEnsureChannel, // ensureTextChannel()
+        StageGetMessage, // getMessage() and the dialog info
+        StageBuildParts, // The message parts
+        StageMediaInfo, // getMessageMediaInfo() and the media parts
+        StageAddReceivedMessage, // addReceivedMessage()
+        StageDone,
+        StageCount
+    };
+
+    explicit MorseMessageTracer(int capacity = 1000);
+
+    bool isEnabled() const { return m_enabled; }
+    void setEnabled(bool enabled);
+
+    int capacity() const { return m_capacity; }
+    int count() const { return m_count; }
+
+    void begin(const Telegram::Peer &peer, quint32 messageId);
+    void setServerDate(quint32 date);
+    void stamp(Stage stage);
+    void finish();
+    void discard();
+    void clear();
+
+    void queue();
+    bool resume(const Telegram::Peer &peer, quint32 messageId);
+    void clearQueued();
+
+    QByteArray toChromeTrace() const;
+
+    static const char *stageName(Stage stage);
+
+protected:
+    struct Record
+    {
+        Telegram::Peer peer;
+        quint32 messageId = 0;
+        quint32 serverDate = 0; // Seconds since epoch
+        qint64 stamps[StageCount]; // us since epoch, 0 for the skipped stages
+    };
+
+    qint64 now() const;
+
+    using RecordKey = QPair<Telegram::Peer, quint32>;
+
+    QVector<Record> m_records; // Allocated on enable
+    QHash<RecordKey, Record> m_queued; // Parked by queue(), at most capacity()
+    Record m_currentRecord;
+    Record *m_current = nullptr; // The open record, if any
+    QElapsedTimer m_clock;
+    qint64 m_epochOffset = 0; // us since epoch at m_clock start
+    int m_capacity;
+    int m_next = 0;
+    int m_count = 0;
+    bool m_enabled = false;
+};
+
+inline void MorseMessageTracer::stamp(Stage stage)
+{
+    if (m_current) {
+        m_current->stamps[stage] = now();
+    }
+}
+
+#endif // MORSE_MESSAGE_TRACER_HPP
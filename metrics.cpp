@@ -0,0 +1,192 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "metrics.hpp"
+
+#include <QVariantList>
+
+#include <QtAlgorithms>
+
+int MorseHistogram::bucketIndex(quint64 value)
+{
+    if (value < quint64(LinearCount)) {
+        return int(value);
+    }
+    // The position of the highest bit selects the power of two,
+    // the next SubBucketBits bits select the linear sub-bucket.
+    const int exponent = 63 - int(qCountLeadingZeroBits(value));
+    const int subBucket = int(value >> (exponent - SubBucketBits)) & (SubBucketCount - 1);
+    return LinearCount + (exponent - SubBucketBits - 1) * SubBucketCount + subBucket;
+}
+
+quint64 MorseHistogram::bucketUpperBound(int index)
+{
+    if (index < LinearCount) {
+        return quint64(index);
+    }
+    const int exponent = (index - LinearCount) / SubBucketCount + SubBucketBits + 1;
+    const quint64 subBucket = quint64((index - LinearCount) % SubBucketCount);
+    const quint64 width = quint64(1) << (exponent - SubBucketBits);
+    return ((SubBucketCount + subBucket) << (exponent - SubBucketBits)) + width - 1;
+}
+
+void MorseHistogram::record(quint64 value)
+{
+    m_buckets[bucketIndex(value)].fetchAndAddRelaxed(1);
+    m_count.fetchAndAddRelaxed(1);
+    m_sum.fetchAndAddRelaxed(value);
+
+    quint64 max = m_max.loadAcquire();
+    while ((value > max) && !m_max.testAndSetRelaxed(max, value, max)) {
+    }
+}
+
+void MorseHistogram::reset()
+{
+    for (QAtomicInteger<quint64> &bucket : m_buckets) {
+        bucket.storeRelease(0);
+    }
+    m_count.storeRelease(0);
+    m_sum.storeRelease(0);
+    m_max.storeRelease(0);
+}
+
+quint64 MorseHistogram::percentile(double fraction) const
+{
+    const quint64 total = count();
+    if (!total) {
+        return 0;
+    }
+    const quint64 rank = qMax<quint64>(1, quint64(fraction * total + 0.5));
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += m_buckets[i].loadAcquire();
+        if (seen >= rank) {
+            return qMin(bucketUpperBound(i), max());
+        }
+    }
+    return max();
+}
+
+QVariantMap MorseHistogram::toVariantMap() const
+{
+    // The buckets are read one by one while the histogram may be updated,
+    // so the snapshot is consistent only up to the records in flight.
+    QVariantList bounds;
+    QVariantList counts;
+    for (int i = 0; i < BucketCount; ++i) {
+        const quint64 bucketCount = m_buckets[i].loadAcquire();
+        if (bucketCount) {
+            bounds.append(bucketUpperBound(i));
+            counts.append(bucketCount);
+        }
+    }
+
+    const quint64 total = count();
+    QVariantMap result;
+    result.insert(QLatin1String("count"), total);
+    result.insert(QLatin1String("sum"), sum());
+    result.insert(QLatin1String("max"), max());
+    result.insert(QLatin1String("mean"), total ? double(sum()) / total : 0.0);
+    result.insert(QLatin1String("p50"), percentile(0.5));
+    result.insert(QLatin1String("p90"), percentile(0.9));
+    result.insert(QLatin1String("p99"), percentile(0.99));
+    result.insert(QLatin1String("p999"), percentile(0.999));
+    result.insert(QLatin1String("bucket-bounds"), bounds);
+    result.insert(QLatin1String("bucket-counts"), counts);
+    return result;
+}
+
+MorseMetrics::ScopedTimer::ScopedTimer(MorseMetrics *metrics, Histogram histogram) :
+    m_metrics(metrics),
+    m_histogram(histogram)
+{
+    m_timer.start();
+}
+
+MorseMetrics::ScopedTimer::~ScopedTimer()
+{
+    m_metrics->record(m_histogram, m_timer);
+}
+
+void MorseMetrics::reset()
+{
+    for (QAtomicInteger<quint64> &counter : m_counters) {
+        counter.storeRelease(0);
+    }
+    for (MorseHistogram &histogram : m_histograms) {
+        histogram.reset();
+    }
+}
+
+QVariantMap MorseMetrics::counters() const
+{
+    QVariantMap result;
+    for (int i = 0; i < CounterCount; ++i) {
+        result.insert(QLatin1String(counterName(Counter(i))), counter(Counter(i)));
+    }
+    return result;
+}
+
+QVariantMap MorseMetrics::histograms() const
+{
+    QVariantMap result;
+    for (int i = 0; i < HistogramCount; ++i) {
+        result.insert(QLatin1String(histogramName(Histogram(i))), m_histograms[i].toVariantMap());
+    }
+    return result;
+}
+
+const char *MorseMetrics::counterName(Counter counter)
+{
+    switch (counter) {
+    case MessagesReceived:
+        return "messages-received";
+    case MessagesSent:
+        return "messages-sent";
+    case AvatarsFetched:
+        return "avatars-fetched";
+    case AvatarCacheHits:
+        return "avatar-cache-hits";
+    case StateSaves:
+        return "state-saves";
+    case BytesWritten:
+        return "bytes-written";
+    case CounterCount:
+        break;
+    }
+    return "";
+}
+
+const char *MorseMetrics::histogramName(Histogram histogram)
+{
+    switch (histogram) {
+    case ReceiveLatency:
+        return "receive-latency";
+    case SendLatency:
+        return "send-latency";
+    case StateSaveDuration:
+        return "state-save-duration";
+    case ContactAttributesDuration:
+        return "contact-attributes-duration";
+    case HistogramCount:
+        break;
+    }
+    return "";
+}
@@ -0,0 +1,137 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MORSE_METRICS_HPP
+#define MORSE_METRICS_HPP
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QVariantMap>
+
+/**
+ * Log-linear latency histogram.
+ *
+ * Values below 16 have their own buckets; every next power of two is split into 8 linear
+ * sub-buckets, so the relative error of a reported value is below 12.5%. The buckets
+ * are fixed atomic counters: record() is lock-free, does not allocate and can be called
+ * from any thread.
+ */
+class MorseHistogram
+{
+public:
+    enum {
+        SubBucketBits = 3,
+        SubBucketCount = 1 << SubBucketBits,
+        LinearCount = SubBucketCount * 2,
+        BucketCount = LinearCount + (64 - SubBucketBits - 1) * SubBucketCount,
+    };
+
+    void record(quint64 value);
+    void reset();
+
+    quint64 count() const { return m_count.loadAcquire(); }
+    quint64 sum() const { return m_sum.loadAcquire(); }
+    quint64 max() const { return m_max.loadAcquire(); }
+    quint64 percentile(double fraction) const;
+
+    QVariantMap toVariantMap() const;
+
+    static int bucketIndex(quint64 value);
+    static quint64 bucketUpperBound(int index);
+
+protected:
+    QAtomicInteger<quint64> m_buckets[BucketCount];
+    QAtomicInteger<quint64> m_count;
+    QAtomicInteger<quint64> m_sum;
+    QAtomicInteger<quint64> m_max;
+};
+
+/**
+ * Connection counters and latency histograms (in microseconds).
+ *
+ * Recording is lock-free and allocation-free; the maps are built only on a scrape.
+ */
+class MorseMetrics
+{
+public:
+    enum Counter {
+        MessagesReceived,
+        MessagesSent,
+        AvatarsFetched,
+        AvatarCacheHits,
+        StateSaves,
+        BytesWritten,
+        CounterCount
+    };
+
+    enum Histogram {
+        ReceiveLatency, // From the TelegramQt update to addReceivedMessage(); not recorded for the messages queued behind a backlog
+        SendLatency, // From sendMessageCallback() to onMessageSent()
+        StateSaveDuration,
+        ContactAttributesDuration, // getContactAttributes() call time
+        HistogramCount
+    };
+
+    class ScopedTimer
+    {
+    public:
+        ScopedTimer(MorseMetrics *metrics, Histogram histogram);
+        ~ScopedTimer();
+
+    protected:
+        MorseMetrics *m_metrics;
+        Histogram m_histogram;
+        QElapsedTimer m_timer;
+    };
+
+    void increment(Counter counter, quint64 value = 1);
+    void record(Histogram histogram, quint64 microseconds);
+    void record(Histogram histogram, const QElapsedTimer &timer);
+    void reset();
+
+    quint64 counter(Counter counter) const { return m_counters[counter].loadAcquire(); }
+    const MorseHistogram &histogram(Histogram histogram) const { return m_histograms[histogram]; }
+
+    QVariantMap counters() const;
+    QVariantMap histograms() const;
+
+    static const char *counterName(Counter counter);
+    static const char *histogramName(Histogram histogram);
+
+protected:
+    QAtomicInteger<quint64> m_counters[CounterCount];
+    MorseHistogram m_histograms[HistogramCount];
+};
+
+inline void MorseMetrics::increment(Counter counter, quint64 value)
+{
+    m_counters[counter].fetchAndAddRelaxed(value);
+}
+
+inline void MorseMetrics::record(Histogram histogram, quint64 microseconds)
+{
+    m_histograms[histogram].record(microseconds);
+}
+
+inline void MorseMetrics::record(Histogram histogram, const QElapsedTimer &timer)
+{
+    m_histograms[histogram].record(quint64(timer.nsecsElapsed() / 1000));
+}
+
+#endif // MORSE_METRICS_HPP
@@ -0,0 +1,98 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "metricsinterface.hpp"
+#include "messagetracer.hpp"
+#include "metrics.hpp"
+
+#include <TelepathyQt/DBusObject>
+
+MorseMetricsInterface::MorseMetricsInterface(const QSharedPointer<MorseMetrics> &metrics, MorseMessageTracer *tracer)
+    : AbstractConnectionInterface(QLatin1String(MORSE_IFACE_METRICS)),
+      m_metrics(metrics),
+      m_tracer(tracer)
+{
+}
+
+QVariantMap MorseMetricsInterface::immutableProperties() const
+{
+    QVariantMap map;
+    return map;
+}
+
+QVariantMap MorseMetricsInterface::counters() const
+{
+    return m_metrics->counters();
+}
+
+QVariantMap MorseMetricsInterface::histograms() const
+{
+    return m_metrics->histograms();
+}
+
+void MorseMetricsInterface::reset()
+{
+    m_metrics->reset();
+}
+
+void MorseMetricsInterface::setMessageTracingEnabled(bool enabled)
+{
+    m_tracer->setEnabled(enabled);
+}
+
+QString MorseMetricsInterface::messageTrace() const
+{
+    return QString::fromUtf8(m_tracer->toChromeTrace());
+}
+
+void MorseMetricsInterface::createAdaptor()
+{
+    (void) new MorseMetricsAdaptor(this, dbusObject());
+}
+
+MorseMetricsAdaptor::MorseMetricsAdaptor(MorseMetricsInterface *interface, QObject *parent) :
+    QDBusAbstractAdaptor(parent),
+    m_interface(interface)
+{
+}
+
+QVariantMap MorseMetricsAdaptor::GetCounters()
+{
+    return m_interface->counters();
+}
+
+QVariantMap MorseMetricsAdaptor::GetHistograms()
+{
+    return m_interface->histograms();
+}
+
+void MorseMetricsAdaptor::Reset()
+{
+    m_interface->reset();
+}
+
+void MorseMetricsAdaptor::SetMessageTracing(bool enabled)
+{
+    m_interface->setMessageTracingEnabled(enabled);
+}
+
+QString MorseMetricsAdaptor::GetMessageTrace()
+{
+    return m_interface->messageTrace();
+}
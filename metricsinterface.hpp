@@ -0,0 +1,112 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MORSE_METRICS_INTERFACE_HPP
+#define MORSE_METRICS_INTERFACE_HPP
+
+#include <TelepathyQt/BaseConnection>
+
+#include <QDBusAbstractAdaptor>
+#include <QSharedPointer>
+
+#define MORSE_IFACE_METRICS "org.freedesktop.Telepathy.Morse.Metrics"
+
+class MorseMessageTracer;
+class MorseMetrics;
+
+class MorseMetricsInterface;
+typedef Tp::SharedPtr<MorseMetricsInterface> MorseMetricsInterfacePtr;
+
+/**
+ * Connection interface exposing MorseMetrics.
+ *
+ * GetCounters() returns the counters as uint64 values; GetHistograms() returns a map of
+ * the histogram name to a{sv} with count, sum, max, mean, p50, p90, p99, p999 and
+ * the non-empty buckets (inclusive upper bounds and counts). All times are in microseconds.
+ *
+ * SetMessageTracing() toggles the per-stage tracing of the incoming messages;
+ * GetMessageTrace() returns the traced messages as Chrome trace-event JSON.
+ */
+class MorseMetricsInterface : public Tp::AbstractConnectionInterface
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(MorseMetricsInterface)
+
+public:
+    static MorseMetricsInterfacePtr create(const QSharedPointer<MorseMetrics> &metrics, MorseMessageTracer *tracer)
+    {
+        return MorseMetricsInterfacePtr(new MorseMetricsInterface(metrics, tracer));
+    }
+
+    QVariantMap immutableProperties() const;
+
+    QVariantMap counters() const;
+    QVariantMap histograms() const;
+    void reset();
+
+    void setMessageTracingEnabled(bool enabled);
+    QString messageTrace() const;
+
+protected:
+    MorseMetricsInterface(const QSharedPointer<MorseMetrics> &metrics, MorseMessageTracer *tracer);
+
+private:
+    void createAdaptor();
+
+    QSharedPointer<MorseMetrics> m_metrics;
+    MorseMessageTracer *m_tracer;
+};
+
+class MorseMetricsAdaptor : public QDBusAbstractAdaptor
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", MORSE_IFACE_METRICS)
+    Q_CLASSINFO("D-Bus Introspection", ""
+"  <interface name=\"" MORSE_IFACE_METRICS "\">\n"
+"    <method name=\"GetCounters\">\n"
+"      <arg direction=\"out\" type=\"a{sv}\" name=\"Counters\"/>\n"
+"    </method>\n"
+"    <method name=\"GetHistograms\">\n"
+"      <arg direction=\"out\" type=\"a{sv}\" name=\"Histograms\"/>\n"
+"    </method>\n"
+"    <method name=\"Reset\"/>\n"
+"    <method name=\"SetMessageTracing\">\n"
+"      <arg direction=\"in\" type=\"b\" name=\"Enabled\"/>\n"
+"    </method>\n"
+"    <method name=\"GetMessageTrace\">\n"
+"      <arg direction=\"out\" type=\"s\" name=\"Trace\"/>\n"
+"    </method>\n"
+"  </interface>\n"
+"")
+
+public:
+    MorseMetricsAdaptor(MorseMetricsInterface *interface, QObject *parent);
+
+public slots:
+    QVariantMap GetCounters();
+    QVariantMap GetHistograms();
+    void Reset();
+    void SetMessageTracing(bool enabled);
+    QString GetMessageTrace();
+
+private:
+    MorseMetricsInterface *m_interface;
+};
+
+#endif // MORSE_METRICS_INTERFACE_HPP
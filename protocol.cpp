@@ -19,6 +19,7 @@
 
 #include "protocol.hpp"
 #include "connection.hpp"
+#include "logging.hpp"
 
 #include <TelegramQt/TelegramNamespace>
 
@@ -43,11 +44,18 @@ static const QLatin1String c_proxyUsername= QLatin1String("proxy-username");
 static const QLatin1String c_proxyPassword = QLatin1String("proxy-password");
 static const QLatin1String c_keepalive = QLatin1String("keepalive");
 static const QLatin1String c_keepaliveInterval = QLatin1String("keepalive-interval");
+static const QLatin1String c_stateJournal = QLatin1String("state-journal");
+static const QLatin1String c_stateCompression = QLatin1String("state-compression");
+static const QLatin1String c_stateCompressionLevel = QLatin1String("state-compression-level");
+static const QLatin1String c_syncLimit = QLatin1String("sync-limit");
+static const QLatin1String c_syncMaxLimit = QLatin1String("sync-max-limit");
+static const QLatin1String c_syncImmediateDialogs = QLatin1String("sync-immediate-dialogs");
+static const QLatin1String c_syncConcurrency = QLatin1String("sync-concurrency");
 
 MorseProtocol::MorseProtocol(const QDBusConnection &dbusConnection, const QString &name)
     : BaseProtocol(dbusConnection, name)
 {
-    qDebug() << Q_FUNC_INFO;
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO;
     setEnglishName(QLatin1String("Telegram"));
     setIconName(QLatin1String("telegram"));
     setVCardField(QLatin1String("tel"));
@@ -60,6 +68,13 @@ MorseProtocol::MorseProtocol(const QDBusConnection &dbusConnection, const QStrin
                   << Tp::ProtocolParameter(c_serverKey, QLatin1String("s"), Tp::ConnMgrParamFlagHasDefault, QString())
                   << Tp::ProtocolParameter(c_keepalive, QLatin1String("b"), Tp::ConnMgrParamFlagHasDefault, true)
                   << Tp::ProtocolParameter(c_keepaliveInterval, QLatin1String("u"), Tp::ConnMgrParamFlagHasDefault, 15)
+                  << Tp::ProtocolParameter(c_stateJournal, QLatin1String("b"), Tp::ConnMgrParamFlagHasDefault, true)
+                  << Tp::ProtocolParameter(c_stateCompression, QLatin1String("s"), Tp::ConnMgrParamFlagHasDefault, QStringLiteral("zlib")) // "zlib" or "none"
+                  << Tp::ProtocolParameter(c_stateCompressionLevel, QLatin1String("i"), Tp::ConnMgrParamFlagHasDefault, -1)
+                  << Tp::ProtocolParameter(c_syncLimit, QLatin1String("u"), Tp::ConnMgrParamFlagHasDefault, 30)
+                  << Tp::ProtocolParameter(c_syncMaxLimit, QLatin1String("u"), Tp::ConnMgrParamFlagHasDefault, 200)
+                  << Tp::ProtocolParameter(c_syncImmediateDialogs, QLatin1String("u"), Tp::ConnMgrParamFlagHasDefault, 10)
+                  << Tp::ProtocolParameter(c_syncConcurrency, QLatin1String("u"), Tp::ConnMgrParamFlagHasDefault, 4)
                   << Tp::ProtocolParameter(c_proxyType, QLatin1String("s"), 0) // ATM we have only socks5 support, but Telegram supports http-proxy too
                   << Tp::ProtocolParameter(c_proxyAddress, QLatin1String("s"), 0)
                   << Tp::ProtocolParameter(c_proxyPort, QLatin1String("u"), 0)
@@ -149,9 +164,44 @@ uint MorseProtocol::getKeepAliveInterval(const QVariantMap &parameters, uint def
     return parameters.value(c_keepaliveInterval, defaultValue).toUInt();
 }
 
+bool MorseProtocol::getStateJournalEnabled(const QVariantMap &parameters)
+{
+    return parameters.value(c_stateJournal, true).toBool();
+}
+
+QString MorseProtocol::getStateCompression(const QVariantMap &parameters)
+{
+    return parameters.value(c_stateCompression, QStringLiteral("zlib")).toString();
+}
+
+int MorseProtocol::getStateCompressionLevel(const QVariantMap &parameters)
+{
+    return parameters.value(c_stateCompressionLevel, -1).toInt();
+}
+
+uint MorseProtocol::getSyncLimit(const QVariantMap &parameters)
+{
+    return parameters.value(c_syncLimit, 30u).toUInt();
+}
+
+uint MorseProtocol::getSyncMaxLimit(const QVariantMap &parameters)
+{
+    return parameters.value(c_syncMaxLimit, 200u).toUInt();
+}
+
+uint MorseProtocol::getSyncImmediateDialogs(const QVariantMap &parameters)
+{
+    return parameters.value(c_syncImmediateDialogs, 10u).toUInt();
+}
+
+uint MorseProtocol::getSyncConcurrency(const QVariantMap &parameters)
+{
+    return parameters.value(c_syncConcurrency, 4u).toUInt();
+}
+
 Tp::BaseConnectionPtr MorseProtocol::createConnection(const QVariantMap &parameters, Tp::DBusError *error)
 {
-    qDebug() << Q_FUNC_INFO << Telegram::Utils::maskPhoneNumber(parameters, c_account);
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO << Telegram::Utils::maskPhoneNumber(parameters, c_account);
     Q_UNUSED(error)
 
     Tp::BaseConnectionPtr newConnection = Tp::BaseConnection::create<MorseConnection>(QLatin1String("morse"), name(), parameters);
@@ -161,14 +211,14 @@ Tp::BaseConnectionPtr MorseProtocol::createConnection(const QVariantMap &paramet
 
 QString MorseProtocol::identifyAccount(const QVariantMap &parameters, Tp::DBusError *error)
 {
-    qDebug() << Q_FUNC_INFO << parameters;
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO << parameters;
     error->set(QLatin1String("IdentifyAccount.Error.NotImplemented"), QLatin1String(""));
     return QString();
 }
 
 QString MorseProtocol::normalizeContact(const QString &contactId, Tp::DBusError *error)
 {
-    qDebug() << Q_FUNC_INFO << contactId;
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO << contactId;
     error->set(QLatin1String("NormalizeContact.Error.NotImplemented"), QLatin1String(""));
     return QString();
 }
@@ -176,14 +226,14 @@ QString MorseProtocol::normalizeContact(const QString &contactId, Tp::DBusError
 QString MorseProtocol::normalizeVCardAddress(const QString &vcardField, const QString vcardAddress,
         Tp::DBusError *error)
 {
-    qDebug() << Q_FUNC_INFO << vcardField << vcardAddress;
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO << vcardField << vcardAddress;
     error->set(QLatin1String("NormalizeVCardAddress.Error.NotImplemented"), QLatin1String(""));
     return QString();
 }
 
 QString MorseProtocol::normalizeContactUri(const QString &uri, Tp::DBusError *error)
 {
-    qDebug() << Q_FUNC_INFO << uri;
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO << uri;
     error->set(QLatin1String("NormalizeContactUri.Error.NotImplemented"), QLatin1String(""));
     return QString();
 }
@@ -42,6 +42,13 @@ public:
     static QString getProxyUsername(const QVariantMap &parameters);
     static QString getProxyPassword(const QVariantMap &parameters);
     static uint getKeepAliveInterval(const QVariantMap &parameters, uint defaultValue);
+    static bool getStateJournalEnabled(const QVariantMap &parameters);
+    static QString getStateCompression(const QVariantMap &parameters);
+    static int getStateCompressionLevel(const QVariantMap &parameters);
+    static uint getSyncLimit(const QVariantMap &parameters);
+    static uint getSyncMaxLimit(const QVariantMap &parameters);
+    static uint getSyncImmediateDialogs(const QVariantMap &parameters);
+    static uint getSyncConcurrency(const QVariantMap &parameters);
 
 private:
     Tp::BaseConnectionPtr createConnection(const QVariantMap &parameters, Tp::DBusError *error);
@@ -0,0 +1,159 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "reconnectcontroller.hpp"
+#include "logging.hpp"
+
+#include <QDebug>
+#include <QNetworkConfigurationManager>
+#include <QTimer>
+
+MorseReconnectController::MorseReconnectController(QObject *parent) :
+    QObject(parent),
+    m_networkManager(new QNetworkConfigurationManager(this)),
+    m_timer(new QTimer(this)),
+    m_random(std::random_device()())
+{
+    m_timer->setSingleShot(true);
+    connect(m_timer, &QTimer::timeout, this, &MorseReconnectController::onTimeout);
+    connect(m_networkManager, &QNetworkConfigurationManager::onlineStateChanged,
+            this, &MorseReconnectController::onOnlineStateChanged);
+    connect(m_networkManager, &QNetworkConfigurationManager::configurationChanged,
+            this, &MorseReconnectController::onConfigurationChanged);
+}
+
+void MorseReconnectController::setDelays(int minimum, int maximum)
+{
+    m_minimumDelay = qMax(1, minimum);
+    m_maximumDelay = qMax(m_minimumDelay, maximum);
+}
+
+bool MorseReconnectController::isOnline() const
+{
+    // Without a bearer backend there are no configurations and the state is unknown
+    if (m_networkManager->allConfigurations().isEmpty()) {
+        return true;
+    }
+    return m_networkManager->isOnline();
+}
+
+void MorseReconnectController::connectionLost()
+{
+    if (m_active) {
+        return;
+    }
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO;
+    m_active = true;
+    m_attempt = 0;
+    m_defaultConfiguration.clear();
+    scheduleAttempt();
+}
+
+void MorseReconnectController::connectionRestored()
+{
+    if (m_active) {
+        qCDebug(lcMorseConnection) << Q_FUNC_INFO << "after" << m_attempt << "attempts";
+    }
+    m_active = false;
+    m_attempt = 0;
+    m_timer->stop();
+    m_defaultConfiguration = m_networkManager->defaultConfiguration().identifier();
+}
+
+void MorseReconnectController::stop()
+{
+    m_active = false;
+    m_attempt = 0;
+    m_timer->stop();
+    m_defaultConfiguration.clear();
+}
+
+void MorseReconnectController::scheduleAttempt()
+{
+    if (!m_active || m_timer->isActive()) {
+        return;
+    }
+    const int delay = nextDelay();
+    ++m_attempt;
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO << "attempt" << m_attempt << "in" << delay << "ms";
+    m_timer->start(delay);
+}
+
+int MorseReconnectController::nextDelay()
+{
+    // Equal jitter: half of the exponential delay is kept to space the attempts,
+    // the other half is randomized to spread the clients reconnecting at once.
+    const int shift = qMin(m_attempt, 16);
+    const qint64 delay = qMin<qint64>(m_maximumDelay, qint64(m_minimumDelay) << shift);
+    std::uniform_int_distribution<int> jitter(0, int(delay / 2));
+    return int(delay - delay / 2) + jitter(m_random);
+}
+
+void MorseReconnectController::onTimeout()
+{
+    // The next attempt is scheduled right away: if this one does not complete,
+    // the following one is requested after the backoff anyway.
+    const bool online = isOnline();
+    scheduleAttempt();
+    if (!online) {
+        qCDebug(lcMorseConnection) << Q_FUNC_INFO << "The network is offline, wait for the link";
+        return;
+    }
+    emit reconnectRequested();
+}
+
+void MorseReconnectController::onOnlineStateChanged(bool online)
+{
+    qCDebug(lcMorseConnection) << Q_FUNC_INFO << online;
+    if (m_active) {
+        if (online) {
+            m_attempt = 0;
+            m_timer->start(0);
+        }
+    } else if (!online && !m_defaultConfiguration.isNull()) {
+        emit networkChanged();
+    }
+}
+
+void MorseReconnectController::onConfigurationChanged(const QNetworkConfiguration &configuration)
+{
+    const bool active = configuration.state().testFlag(QNetworkConfiguration::Active);
+    if (m_active) {
+        // A link came up while waiting for a backed off attempt
+        if (active && (m_timer->remainingTime() > m_minimumDelay)) {
+            qCDebug(lcMorseConnection) << Q_FUNC_INFO << "Network" << configuration.name() << "is up";
+            m_attempt = 0;
+            m_timer->start(0);
+        }
+        return;
+    }
+
+    if (m_defaultConfiguration.isNull()) {
+        // Not connected yet or disconnected on request
+        return;
+    }
+
+    const QString defaultConfiguration = m_networkManager->defaultConfiguration().identifier();
+    const bool lost = (configuration.identifier() == m_defaultConfiguration) && !active;
+    if (lost || (defaultConfiguration != m_defaultConfiguration)) {
+        qCDebug(lcMorseConnection) << Q_FUNC_INFO << "Network" << m_defaultConfiguration << "is replaced by" << defaultConfiguration;
+        m_defaultConfiguration = defaultConfiguration;
+        emit networkChanged();
+    }
+}
@@ -0,0 +1,80 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MORSE_RECONNECT_CONTROLLER_HPP
+#define MORSE_RECONNECT_CONTROLLER_HPP
+
+#include <QObject>
+#include <QString>
+
+#include <random>
+
+QT_FORWARD_DECLARE_CLASS(QNetworkConfiguration)
+QT_FORWARD_DECLARE_CLASS(QNetworkConfigurationManager)
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
+/**
+ * Reconnection policy.
+ *
+ * Once the connection is lost, reconnectRequested() is emitted with a jittered exponential
+ * backoff between minimumDelay() and maximumDelay() until connectionRestored() is called.
+ * The network link changes cut the wait: a reconnection is requested right away when the link
+ * comes back online, and networkChanged() is emitted when the default network goes away
+ * or is replaced while the connection is alive, because the old socket is most likely dead.
+ */
+class MorseReconnectController : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MorseReconnectController(QObject *parent = nullptr);
+
+    int minimumDelay() const { return m_minimumDelay; }
+    int maximumDelay() const { return m_maximumDelay; }
+    void setDelays(int minimum, int maximum);
+
+    bool isActive() const { return m_active; }
+    int attempt() const { return m_attempt; }
+    bool isOnline() const;
+
+    void connectionLost();
+    void connectionRestored();
+    void stop();
+
+signals:
+    void reconnectRequested();
+    void networkChanged();
+
+protected:
+    void scheduleAttempt();
+    int nextDelay();
+    void onTimeout();
+    void onOnlineStateChanged(bool online);
+    void onConfigurationChanged(const QNetworkConfiguration &configuration);
+
+    QNetworkConfigurationManager *m_networkManager = nullptr;
+    QTimer *m_timer = nullptr;
+    QString m_defaultConfiguration; // Identifier of the network used by the current connection
+    std::mt19937 m_random;
+    int m_minimumDelay = 1000; // ms
+    int m_maximumDelay = 60000; // ms
+    int m_attempt = 0;
+    bool m_active = false;
+};
+
+#endif // MORSE_RECONNECT_CONTROLLER_HPP
@@ -10,6 +10,7 @@ Requires:   telepathy-mission-control
 BuildRequires: pkgconfig(dbus-1) >= 1.1.0
 BuildRequires: pkgconfig(Qt5Core)
 BuildRequires: pkgconfig(Qt5DBus)
+BuildRequires: pkgconfig(Qt5Gui)
 BuildRequires: pkgconfig(Qt5Network)
 BuildRequires: pkgconfig(Qt5Qml)
 BuildRequires: pkgconfig(TelegramQt5) >= 0.2.0
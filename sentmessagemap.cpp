@@ -0,0 +1,128 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "sentmessagemap.hpp"
+
+#include <QVector>
+
+#include <algorithm>
+
+MorseSentMessageMap::MorseSentMessageMap(int limit) :
+    m_limit(limit)
+{
+}
+
+void MorseSentMessageMap::setLimit(int limit)
+{
+    m_limit = limit;
+}
+
+int MorseSentMessageMap::count() const
+{
+    int result = 0;
+    for (const PeerMap &map : m_peers) {
+        result += map.randomIds.count();
+    }
+    return result;
+}
+
+quint64 MorseSentMessageMap::randomId(const Telegram::Peer &peer, quint32 messageId) const
+{
+    const auto peerIt = m_peers.constFind(peer);
+    if (peerIt == m_peers.constEnd()) {
+        return 0;
+    }
+    const auto it = peerIt->randomIds.constFind(messageId);
+    if (it == peerIt->randomIds.constEnd()) {
+        return 0;
+    }
+    it->lastUsed = ++m_clock;
+    return it->randomId;
+}
+
+quint32 MorseSentMessageMap::messageId(const Telegram::Peer &peer, quint64 randomId) const
+{
+    const auto peerIt = m_peers.constFind(peer);
+    if (peerIt == m_peers.constEnd()) {
+        return 0;
+    }
+    const quint32 result = peerIt->messageIds.value(randomId);
+    const auto it = peerIt->randomIds.constFind(result);
+    if (it != peerIt->randomIds.constEnd()) {
+        it->lastUsed = ++m_clock;
+    }
+    return result;
+}
+
+void MorseSentMessageMap::insert(const Telegram::Peer &peer, quint32 messageId, quint64 randomId)
+{
+    PeerMap &map = m_peers[peer];
+
+    const auto existing = map.randomIds.constFind(messageId);
+    if (existing != map.randomIds.constEnd()) {
+        map.messageIds.remove(existing->randomId);
+    }
+    // Drop the message the random id pointed to, so its eviction does not remove the new mapping
+    const auto previous = map.messageIds.constFind(randomId);
+    if ((previous != map.messageIds.constEnd()) && (previous.value() != messageId)) {
+        map.randomIds.remove(previous.value());
+    }
+
+    Entry entry;
+    entry.randomId = randomId;
+    entry.lastUsed = ++m_clock;
+    map.randomIds.insert(messageId, entry);
+    map.messageIds.insert(randomId, messageId);
+
+    // Evict in batches to keep the amortized insertion cost constant
+    if ((m_limit > 0) && (map.randomIds.count() > m_limit + m_limit / 4)) {
+        evict(&map);
+    }
+}
+
+void MorseSentMessageMap::clear()
+{
+    m_peers.clear();
+}
+
+void MorseSentMessageMap::evict(PeerMap *map)
+{
+    const int excess = map->randomIds.count() - m_limit;
+    if (excess <= 0) {
+        return;
+    }
+
+    QVector<quint64> stamps;
+    stamps.reserve(map->randomIds.count());
+    for (const Entry &entry : map->randomIds) {
+        stamps.append(entry.lastUsed);
+    }
+    // The stamps are unique, so everything below the threshold is exactly the excess
+    std::nth_element(stamps.begin(), stamps.begin() + excess, stamps.end());
+    const quint64 threshold = stamps.at(excess);
+
+    for (auto it = map->randomIds.begin(); it != map->randomIds.end(); ) {
+        if (it->lastUsed < threshold) {
+            map->messageIds.remove(it->randomId);
+            it = map->randomIds.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
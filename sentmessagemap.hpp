@@ -0,0 +1,84 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MORSE_SENT_MESSAGE_MAP_HPP
+#define MORSE_SENT_MESSAGE_MAP_HPP
+
+#include <QHash>
+
+#include <TelegramQt/TelegramNamespace>
+
+/**
+ * Per-peer bidirectional messageId <-> randomId map.
+ *
+ * The random id is the token of a message sent by the local user, the message id is the one
+ * assigned by the server. Both directions are hash lookups. Each peer keeps at most limit()
+ * entries; the least recently used ones are evicted in batches.
+ */
+class MorseSentMessageMap
+{
+public:
+    explicit MorseSentMessageMap(int limit = 1000);
+
+    int limit() const { return m_limit; }
+    void setLimit(int limit);
+
+    int count() const;
+
+    quint64 randomId(const Telegram::Peer &peer, quint32 messageId) const;
+    quint32 messageId(const Telegram::Peer &peer, quint64 randomId) const;
+
+    void insert(const Telegram::Peer &peer, quint32 messageId, quint64 randomId);
+    void clear();
+
+    template <typename Function>
+    void forEach(Function function) const;
+
+protected:
+    struct Entry
+    {
+        quint64 randomId = 0;
+        mutable quint64 lastUsed = 0;
+    };
+
+    struct PeerMap
+    {
+        QHash<quint32, Entry> randomIds; // messageId to entry
+        QHash<quint64, quint32> messageIds; // randomId to messageId
+    };
+
+    void evict(PeerMap *map);
+
+    QHash<Telegram::Peer, PeerMap> m_peers;
+    int m_limit;
+    mutable quint64 m_clock = 0;
+};
+
+template <typename Function>
+void MorseSentMessageMap::forEach(Function function) const
+{
+    for (auto peerIt = m_peers.constBegin(); peerIt != m_peers.constEnd(); ++peerIt) {
+        const QHash<quint32, Entry> &randomIds = peerIt.value().randomIds;
+        for (auto it = randomIds.constBegin(); it != randomIds.constEnd(); ++it) {
+            function(peerIt.key(), it.key(), it.value().randomId);
+        }
+    }
+}
+
+#endif // MORSE_SENT_MESSAGE_MAP_HPP
@@ -0,0 +1,733 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "statejournal.hpp"
+#include "logging.hpp"
+#include "storagewriter.hpp"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+
+static const quint32 c_snapshotMagic = 0x4d535332; // MSS2
+static const quint16 c_snapshotVersion = 2;
+static const int c_snapshotHeaderSize = 8; // magic, version, section count
+static const int c_sectionEntrySize = 25; // id, codec, offset, stored size, raw size, checksum
+static const quint32 c_journalMagic = 0x4d534a31; // MSJ1
+static const quint32 c_packedBlobMagic = 0x4d534331; // MSC1
+static const int c_packedBlobHeaderSize = 5; // magic, codec
+static const int c_journalHeaderSize = 16; // magic, snapshot checksum, snapshot size
+static const int c_recordHeaderSize = 8; // size, checksum
+static const int c_maxJournalRecords = 128;
+
+static const int c_minChunkSize = 256;
+static const int c_maxChunkSize = 8192;
+static const quint32 c_chunkBoundaryMask = 0xffc00000u; // 10 bits, ~1 KB average chunk
+
+enum DeltaOperation : quint8 {
+    DeltaCopy,
+    DeltaData,
+};
+
+static const quint32 *gearTable()
+{
+    static const QVector<quint32> table = []() {
+        QVector<quint32> result(256);
+        quint32 state = 0x9e3779b9u;
+        for (quint32 &value : result) {
+            // xorshift32, the table must be the same in every run
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            value = state;
+        }
+        return result;
+    }();
+    return table.constData();
+}
+
+static uint chunkHash(const QByteArray &data, const MorseStateJournal::Chunk &chunk)
+{
+    return qHash(QByteArray::fromRawData(data.constData() + chunk.offset, chunk.size));
+}
+
+void MorseStateJournal::setSnapshotFileName(const QString &fileName)
+{
+    m_snapshotFileName = fileName;
+}
+
+void MorseStateJournal::setJournalFileName(const QString &fileName)
+{
+    m_journalFileName = fileName;
+}
+
+void MorseStateJournal::setJournalEnabled(bool enabled)
+{
+    m_journalEnabled = enabled;
+}
+
+/**
+ * Set the codec for the new snapshots and journal records.
+ *
+ * The codec is recorded with the data, so the files written with another codec are still read.
+ * \a level is the zlib compression level, -1 means the zlib default.
+ */
+void MorseStateJournal::setCompression(Codec codec, int level)
+{
+    m_codec = codec;
+    m_compressionLevel = qBound(-1, level, 9);
+}
+
+MorseStateJournal::~MorseStateJournal()
+{
+    close();
+}
+
+/**
+ * Map the snapshot file and read its section index.
+ *
+ * Nothing is decoded until load() is called.
+ */
+bool MorseStateJournal::open()
+{
+    close();
+
+    m_mappedFile.setFileName(m_snapshotFileName);
+    if (!m_mappedFile.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const qint64 size = m_mappedFile.size();
+    m_mappedData = size ? m_mappedFile.map(0, size) : nullptr;
+    if (!m_mappedData) {
+        qCWarning(lcMorseStorage) << Q_FUNC_INFO << "Unable to map state file" << m_mappedFile.fileName();
+        close();
+        return false;
+    }
+    m_mappedSize = size;
+
+    const QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char *>(m_mappedData),
+                                                    static_cast<int>(m_mappedSize));
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic = 0;
+    quint16 version = 0;
+    quint16 sectionCount = 0;
+    stream >> magic >> version >> sectionCount;
+    if ((stream.status() != QDataStream::Ok) || (magic != c_snapshotMagic)) {
+        // The snapshot written before the sectioned format is a single packed blob
+        return true;
+    }
+    if ((version > c_snapshotVersion)
+            || (c_snapshotHeaderSize + c_sectionEntrySize * sectionCount > m_mappedSize)) {
+        qCWarning(lcMorseStorage) << Q_FUNC_INFO << "Unsupported state file" << m_mappedFile.fileName() << "version" << version;
+        close();
+        return false;
+    }
+
+    m_sections.reserve(sectionCount);
+    for (int i = 0; i < sectionCount; ++i) {
+        SectionEntry entry;
+        stream >> entry.id >> entry.codec >> entry.offset >> entry.storedSize >> entry.rawSize >> entry.checksum;
+        if ((stream.status() != QDataStream::Ok)
+                || (entry.offset + entry.storedSize > static_cast<quint64>(m_mappedSize))) {
+            qCWarning(lcMorseStorage) << Q_FUNC_INFO << "Invalid section index in state file" << m_mappedFile.fileName();
+            close();
+            return false;
+        }
+        m_sections.append(entry);
+    }
+    return true;
+}
+
+void MorseStateJournal::close()
+{
+    if (m_mappedData) {
+        m_mappedFile.unmap(m_mappedData);
+        m_mappedData = nullptr;
+    }
+    m_mappedFile.close();
+    m_mappedSize = 0;
+    m_sections.clear();
+}
+
+/**
+ * Decode the snapshot and replay the journal.
+ *
+ * The files are only read here. A stale journal, a torn journal tail or a journal left
+ * from the journaled mode are not fixed in place; they are reported by needsRepair()
+ * and fixed by the batch prepared with prepareRepair() in the storage writer thread.
+ */
+bool MorseStateJournal::load(QByteArray *state)
+{
+    if (!isOpen() && !open()) {
+        return false;
+    }
+
+    QByteArray current;
+    if (m_sections.isEmpty()) {
+        const QByteArray data(reinterpret_cast<const char *>(m_mappedData), static_cast<int>(m_mappedSize));
+        if (!unpackBlob(data, &current)) {
+            qCWarning(lcMorseStorage) << Q_FUNC_INFO << "Unable to decode state file" << m_snapshotFileName;
+            close();
+            return false;
+        }
+        m_snapshotChecksum = checksum(current);
+    } else {
+        const SectionEntry *entry = findSection(SectionTelegramState);
+        if (!entry || !decodeSection(*entry, &current)) {
+            qCWarning(lcMorseStorage) << Q_FUNC_INFO << "Unable to decode state file" << m_snapshotFileName;
+            close();
+            return false;
+        }
+        m_snapshotChecksum = entry->checksum;
+    }
+    m_storedSnapshotSize = m_mappedSize;
+    // The decoded state does not refer to the mapped memory
+    close();
+
+    m_snapshotSize = current.size();
+    m_journalSize = 0;
+    m_journalRecords = 0;
+    m_repair = RepairNone;
+
+    QFile journalFile(m_journalFileName);
+    if (journalFile.exists() && journalFile.open(QIODevice::ReadOnly)) {
+        QDataStream stream(&journalFile);
+        stream.setVersion(QDataStream::Qt_5_6);
+
+        quint32 magic = 0;
+        quint32 snapshotChecksum = 0;
+        quint64 snapshotSize = 0;
+        stream >> magic >> snapshotChecksum >> snapshotSize;
+
+        if ((magic != c_journalMagic) || (snapshotChecksum != m_snapshotChecksum)
+                || (snapshotSize != static_cast<quint64>(m_snapshotSize))) {
+            // The journal belongs to another snapshot (e.g. the process was killed during compaction)
+            qCDebug(lcMorseStorage) << Q_FUNC_INFO << "Discard stale journal" << journalFile.fileName();
+            m_repair = RepairRemoveJournal;
+        } else {
+            qint64 validSize = c_journalHeaderSize;
+            while (!stream.atEnd()) {
+                quint32 recordSize = 0;
+                quint32 recordChecksum = 0;
+                stream >> recordSize >> recordChecksum;
+                if ((stream.status() != QDataStream::Ok)
+                        || (recordSize > static_cast<quint64>(journalFile.size() - journalFile.pos()))) {
+                    break;
+                }
+                const QByteArray record = journalFile.read(recordSize);
+                if ((record.size() != static_cast<int>(recordSize)) || (checksum(record) != recordChecksum)) {
+                    break;
+                }
+                QByteArray delta;
+                if (!unpackBlob(record, &delta)) {
+                    break;
+                }
+                QByteArray next;
+                if (!applyDelta(current, delta, &next)) {
+                    break;
+                }
+                current = next;
+                validSize = journalFile.pos();
+                ++m_journalRecords;
+            }
+
+            if (validSize != journalFile.size()) {
+                // Drop the partially written tail so the next record is appended after a valid one
+                qCWarning(lcMorseStorage) << Q_FUNC_INFO << "Truncate the journal" << journalFile.fileName()
+                           << "from" << journalFile.size() << "to" << validSize << "bytes";
+                m_repair = RepairTruncateJournal;
+                m_repairJournalSize = validSize;
+            }
+            m_journalSize = validSize - c_journalHeaderSize;
+        }
+    }
+
+    *state = current;
+
+    if (!m_journalEnabled && m_journalRecords) {
+        // Fold the journal left from the journaled mode into the snapshot
+        m_repair = RepairCompact;
+    }
+
+    resetBase(current, m_journalEnabled ? splitChunks(current) : QVector<Chunk>());
+    return true;
+}
+
+/**
+ * Add the file operations needed to fix the issues found by load() to \a batch.
+ *
+ * finishRepair() must be called once the batch is executed.
+ */
+void MorseStateJournal::prepareRepair(MorseStorageBatch *batch)
+{
+    switch (m_repair) {
+    case RepairNone:
+        break;
+    case RepairRemoveJournal:
+        batch->removeFile(m_journalFileName);
+        break;
+    case RepairTruncateJournal:
+        batch->truncateFile(m_journalFileName, m_repairJournalSize);
+        break;
+    case RepairCompact:
+        prepareSnapshot(m_base, batch);
+        break;
+    }
+}
+
+void MorseStateJournal::finishRepair(bool succeeded)
+{
+    if (m_repair == RepairCompact) {
+        finishSave(succeeded);
+    }
+    // On a failure the next save finds the unexpected journal size and writes a complete snapshot
+    m_repair = RepairNone;
+}
+
+bool MorseStateJournal::save(const QByteArray &state)
+{
+    MorseStorageBatch batch;
+    const bool succeeded = prepareSave(state, &batch) && batch.execute();
+    finishSave(succeeded);
+    return succeeded;
+}
+
+/**
+ * Add the file operations needed to persist \a state to \a batch.
+ *
+ * The state is committed only on finishSave(true), which must be called once the batch is executed.
+ */
+bool MorseStateJournal::prepareSave(const QByteArray &state, MorseStorageBatch *batch)
+{
+    if (!m_journalEnabled || m_base.isNull() || (m_repair != RepairNone)) {
+        // A pending repair (the save replaced the repair task in the writer queue) is done by the snapshot too
+        prepareSnapshot(state, batch);
+        return true;
+    }
+
+    const QVector<Chunk> chunks = splitChunks(state);
+    const QByteArray delta = makeDelta(m_base, m_baseIndex, state, chunks);
+
+    if (needsCompaction(delta.size())) {
+        prepareSnapshot(state, batch, chunks);
+        return true;
+    }
+
+    QByteArray data;
+    const qint64 journalFileSize = QFileInfo(m_journalFileName).size();
+    if (journalFileSize == 0) {
+        data = makeJournalHeader();
+    } else if (journalFileSize != c_journalHeaderSize + m_journalSize) {
+        // Somebody else touched the file
+        prepareSnapshot(state, batch, chunks);
+        return true;
+    }
+    const QByteArray record = makeRecord(delta);
+    data.append(record);
+    batch->appendFile(m_journalFileName, data);
+
+    m_pendingState = state;
+    m_pendingChecksum = 0;
+    m_pendingChunks = chunks;
+    m_pendingSnapshot = false;
+    m_pendingRecordSize = record.size();
+    return true;
+}
+
+void MorseStateJournal::finishSave(bool succeeded)
+{
+    if (!succeeded) {
+        // The files are in an unknown state; the next save will write a complete snapshot
+        m_base = QByteArray();
+        m_baseIndex.clear();
+    } else if (m_pendingSnapshot) {
+        m_repair = RepairNone;
+        m_snapshotChecksum = m_pendingChecksum;
+        m_snapshotSize = m_pendingState.size();
+        m_storedSnapshotSize = m_pendingStoredSize;
+        m_journalSize = 0;
+        m_journalRecords = 0;
+        resetBase(m_pendingState, m_pendingChunks);
+    } else {
+        m_journalSize += m_pendingRecordSize;
+        ++m_journalRecords;
+        resetBase(m_pendingState, m_pendingChunks);
+    }
+
+    m_pendingState = QByteArray();
+    m_pendingChunks.clear();
+    m_pendingRecordSize = 0;
+}
+
+void MorseStateJournal::prepareSnapshot(const QByteArray &state, MorseStorageBatch *batch)
+{
+    prepareSnapshot(state, batch, m_journalEnabled ? splitChunks(state) : QVector<Chunk>());
+}
+
+void MorseStateJournal::prepareSnapshot(const QByteArray &state, MorseStorageBatch *batch, const QVector<Chunk> &chunks)
+{
+    m_pendingChecksum = checksum(state);
+    const QByteArray snapshot = packSnapshot(state, m_pendingChecksum, m_codec, m_compressionLevel);
+    m_pendingStoredSize = snapshot.size();
+    batch->replaceFile(m_snapshotFileName, snapshot);
+    // The journal refers to the previous snapshot, so it is obsolete now
+    batch->removeFile(m_journalFileName);
+
+    m_pendingState = state;
+    m_pendingChunks = chunks;
+    m_pendingSnapshot = true;
+    m_pendingRecordSize = 0;
+}
+
+/**
+ * Split \a data into content-defined chunks using a gear rolling hash.
+ *
+ * The boundaries depend only on the nearby bytes, so an insertion or a removal
+ * changes only the chunks around it and the rest of the chunks are found again
+ * at the shifted positions.
+ */
+QVector<MorseStateJournal::Chunk> MorseStateJournal::splitChunks(const QByteArray &data)
+{
+    QVector<Chunk> chunks;
+    chunks.reserve(data.size() / 1024 + 1);
+
+    const quint32 *gear = gearTable();
+    const uchar *bytes = reinterpret_cast<const uchar *>(data.constData());
+    const int size = data.size();
+
+    int start = 0;
+    quint32 hash = 0;
+    for (int i = 0; i < size; ++i) {
+        hash = (hash << 1) + gear[bytes[i]];
+        const int chunkSize = i - start + 1;
+        if (chunkSize < c_minChunkSize) {
+            continue;
+        }
+        if (((hash & c_chunkBoundaryMask) == 0) || (chunkSize >= c_maxChunkSize)) {
+            chunks.append({ start, chunkSize });
+            start = i + 1;
+            hash = 0;
+        }
+    }
+    if (start < size) {
+        chunks.append({ start, size - start });
+    }
+
+    return chunks;
+}
+
+QByteArray MorseStateJournal::makeDelta(const QByteArray &base, const QMultiHash<uint, Chunk> &baseIndex,
+                                        const QByteArray &data, const QVector<Chunk> &dataChunks)
+{
+    QByteArray delta;
+    QDataStream stream(&delta, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << static_cast<quint32>(data.size());
+
+    int copyOffset = 0;
+    int copySize = 0;
+    QByteArray literal;
+
+    const auto flushCopy = [&]() {
+        if (copySize) {
+            stream << static_cast<quint8>(DeltaCopy) << static_cast<quint32>(copyOffset) << static_cast<quint32>(copySize);
+            copySize = 0;
+        }
+    };
+    const auto flushLiteral = [&]() {
+        if (!literal.isEmpty()) {
+            stream << static_cast<quint8>(DeltaData) << literal;
+            literal.clear();
+        }
+    };
+
+    for (const Chunk &chunk : dataChunks) {
+        const char *chunkData = data.constData() + chunk.offset;
+        const uint hash = chunkHash(data, chunk);
+
+        int baseOffset = -1;
+        for (auto it = baseIndex.constFind(hash); (it != baseIndex.constEnd()) && (it.key() == hash); ++it) {
+            if ((it->size == chunk.size) && (memcmp(base.constData() + it->offset, chunkData, chunk.size) == 0)) {
+                baseOffset = it->offset;
+                break;
+            }
+        }
+
+        if (baseOffset < 0) {
+            flushCopy();
+            literal.append(chunkData, chunk.size);
+            continue;
+        }
+
+        flushLiteral();
+        if (copySize && (copyOffset + copySize == baseOffset)) {
+            copySize += chunk.size;
+        } else {
+            flushCopy();
+            copyOffset = baseOffset;
+            copySize = chunk.size;
+        }
+    }
+    flushCopy();
+    flushLiteral();
+
+    return delta;
+}
+
+bool MorseStateJournal::applyDelta(const QByteArray &base, const QByteArray &delta, QByteArray *output)
+{
+    QDataStream stream(delta);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    quint32 resultSize = 0;
+    stream >> resultSize;
+    if (stream.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    QByteArray result;
+    result.reserve(static_cast<int>(resultSize));
+
+    while (!stream.atEnd()) {
+        quint8 operation = 0;
+        stream >> operation;
+        switch (operation) {
+        case DeltaCopy: {
+            quint32 offset = 0;
+            quint32 size = 0;
+            stream >> offset >> size;
+            if ((stream.status() != QDataStream::Ok) || (static_cast<quint64>(offset) + size > static_cast<quint64>(base.size()))) {
+                return false;
+            }
+            result.append(base.constData() + offset, static_cast<int>(size));
+        }
+            break;
+        case DeltaData: {
+            QByteArray literal;
+            stream >> literal;
+            if (stream.status() != QDataStream::Ok) {
+                return false;
+            }
+            result.append(literal);
+        }
+            break;
+        default:
+            return false;
+        }
+    }
+
+    if (static_cast<quint32>(result.size()) != resultSize) {
+        return false;
+    }
+
+    *output = result;
+    return true;
+}
+
+/**
+ * Build a snapshot file with the section index followed by the section data.
+ */
+QByteArray MorseStateJournal::packSnapshot(const QByteArray &state, quint32 stateChecksum,
+                                           Codec codec, int level)
+{
+    const QByteArray payload = encode(state, codec, level);
+
+    SectionEntry entry;
+    entry.id = SectionTelegramState;
+    entry.codec = codec;
+    entry.offset = c_snapshotHeaderSize + c_sectionEntrySize;
+    entry.storedSize = static_cast<quint32>(payload.size());
+    entry.rawSize = static_cast<quint32>(state.size());
+    entry.checksum = stateChecksum;
+
+    QByteArray result;
+    result.reserve(static_cast<int>(entry.offset) + payload.size());
+    QDataStream stream(&result, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << c_snapshotMagic << c_snapshotVersion << static_cast<quint16>(1);
+    stream << entry.id << entry.codec << entry.offset << entry.storedSize << entry.rawSize << entry.checksum;
+    stream.writeRawData(payload.constData(), payload.size());
+    return result;
+}
+
+/**
+ * Compress \a data and prepend it with the codec header.
+ */
+QByteArray MorseStateJournal::packBlob(const QByteArray &data, Codec codec, int level)
+{
+    QByteArray result;
+    QDataStream stream(&result, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << c_packedBlobMagic << static_cast<quint8>(codec);
+
+    const QByteArray encoded = encode(data, codec, level);
+    stream.writeRawData(encoded.constData(), encoded.size());
+    return result;
+}
+
+QByteArray MorseStateJournal::encode(const QByteArray &data, Codec codec, int level)
+{
+    switch (codec) {
+    case CodecNone:
+        return data;
+    case CodecZlib:
+        return qCompress(data, level);
+    }
+    return data;
+}
+
+/**
+ * Parse a codec name as used in the "state-compression" parameter.
+ */
+bool MorseStateJournal::codecFromName(const QString &name, Codec *codec)
+{
+    if (name == QLatin1String("none")) {
+        *codec = CodecNone;
+        return true;
+    }
+    if (name == QLatin1String("zlib")) {
+        *codec = CodecZlib;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Decode a blob produced by packBlob().
+ *
+ * Data without the codec header is taken as is to keep reading the state files
+ * written before the compression support.
+ */
+bool MorseStateJournal::unpackBlob(const QByteArray &data, QByteArray *output)
+{
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_6);
+    quint32 magic = 0;
+    quint8 codec = CodecNone;
+    stream >> magic >> codec;
+    if ((stream.status() != QDataStream::Ok) || (magic != c_packedBlobMagic)) {
+        *output = data;
+        return true;
+    }
+
+    const QByteArray payload = QByteArray::fromRawData(data.constData() + c_packedBlobHeaderSize,
+                                                       data.size() - c_packedBlobHeaderSize);
+    switch (codec) {
+    case CodecNone:
+        *output = QByteArray(payload.constData(), payload.size());
+        return true;
+    case CodecZlib:
+        *output = qUncompress(payload);
+        // qUncompress() returns an empty array on error
+        return !output->isEmpty() || (payload.size() <= 4);
+    default:
+        break;
+    }
+    return false;
+}
+
+quint32 MorseStateJournal::checksum(const QByteArray &data)
+{
+    // FNV-1a
+    quint32 hash = 2166136261u;
+    for (const char c : data) {
+        hash ^= static_cast<uchar>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+const MorseStateJournal::SectionEntry *MorseStateJournal::findSection(quint32 id) const
+{
+    for (const SectionEntry &entry : m_sections) {
+        if (entry.id == id) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+bool MorseStateJournal::decodeSection(const SectionEntry &entry, QByteArray *output) const
+{
+    const char *data = reinterpret_cast<const char *>(m_mappedData) + entry.offset;
+    const int size = static_cast<int>(entry.storedSize);
+
+    QByteArray result;
+    switch (entry.codec) {
+    case CodecNone:
+        result = QByteArray(data, size);
+        break;
+    case CodecZlib:
+        // Decompress straight from the mapped pages
+        result = qUncompress(reinterpret_cast<const uchar *>(data), size);
+        break;
+    default:
+        return false;
+    }
+
+    if ((static_cast<quint32>(result.size()) != entry.rawSize) || (checksum(result) != entry.checksum)) {
+        return false;
+    }
+    *output = result;
+    return true;
+}
+
+bool MorseStateJournal::needsCompaction(int deltaSize) const
+{
+    if (m_journalRecords >= c_maxJournalRecords) {
+        return true;
+    }
+    // Keep the replay cost on load below a half of the snapshot read
+    return (m_journalSize + deltaSize + c_recordHeaderSize) * 2 > m_snapshotSize;
+}
+
+QByteArray MorseStateJournal::makeJournalHeader() const
+{
+    QByteArray header;
+    QDataStream stream(&header, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << c_journalMagic << m_snapshotChecksum << static_cast<quint64>(m_snapshotSize);
+    return header;
+}
+
+QByteArray MorseStateJournal::makeRecord(const QByteArray &delta) const
+{
+    const QByteArray packed = packBlob(delta, m_codec, m_compressionLevel);
+
+    QByteArray record;
+    record.reserve(c_recordHeaderSize + packed.size());
+    QDataStream stream(&record, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << static_cast<quint32>(packed.size()) << checksum(packed);
+    stream.writeRawData(packed.constData(), packed.size());
+    return record;
+}
+
+void MorseStateJournal::resetBase(const QByteArray &state, const QVector<Chunk> &chunks)
+{
+    m_base = state;
+    m_baseIndex.clear();
+    m_baseIndex.reserve(chunks.count());
+    for (const Chunk &chunk : chunks) {
+        m_baseIndex.insert(chunkHash(state, chunk), chunk);
+    }
+}
@@ -0,0 +1,163 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MORSE_STATE_JOURNAL_HPP
+#define MORSE_STATE_JOURNAL_HPP
+
+#include <QByteArray>
+#include <QFile>
+#include <QMultiHash>
+#include <QString>
+#include <QVector>
+
+class MorseStorageBatch;
+
+/**
+ * Snapshot + append-only journal storage for an opaque state blob.
+ *
+ * TelegramQt serializes the whole data storage as a single blob, so the journal records
+ * binary deltas between two consecutive blobs. The blobs are split into content-defined
+ * chunks; the chunks which are already present in the previous blob are written as
+ * references and only the new bytes are appended to the journal. The journal is folded
+ * into a new snapshot once it grows large enough.
+ *
+ * The snapshot file starts with a versioned section index, so the loader maps the file and
+ * decodes only the sections it needs, at the time it needs them.
+ *
+ * The snapshot and the journal records are compressed with the configured codec. The snapshot is replaced atomically
+ * via MorseStorageBatch. The class is not thread-safe; after load() it is expected to be used
+ * only by the storage writer thread.
+ */
+class MorseStateJournal
+{
+public:
+    enum Codec : quint8 {
+        CodecNone,
+        CodecZlib,
+    };
+
+    enum Section : quint32 {
+        SectionTelegramState = 1,
+    };
+
+    struct Chunk
+    {
+        int offset;
+        int size;
+    };
+
+    struct SectionEntry
+    {
+        quint32 id = 0;
+        quint8 codec = CodecNone;
+        quint64 offset = 0; // From the beginning of the file
+        quint32 storedSize = 0;
+        quint32 rawSize = 0;
+        quint32 checksum = 0; // Of the decoded data
+    };
+
+    ~MorseStateJournal();
+
+    void setSnapshotFileName(const QString &fileName);
+    void setJournalFileName(const QString &fileName);
+    void setJournalEnabled(bool enabled);
+    void setCompression(Codec codec, int level = -1);
+
+    bool isJournalEnabled() const { return m_journalEnabled; }
+    Codec codec() const { return m_codec; }
+    int compressionLevel() const { return m_compressionLevel; }
+
+    bool open();
+    void close();
+    bool isOpen() const { return m_mappedData != nullptr; }
+    qint64 mappedSize() const { return m_mappedSize; }
+
+    bool load(QByteArray *state);
+    bool save(const QByteArray &state);
+
+    bool needsRepair() const { return m_repair != RepairNone; }
+    void prepareRepair(MorseStorageBatch *batch);
+    void finishRepair(bool succeeded);
+
+    bool prepareSave(const QByteArray &state, MorseStorageBatch *batch);
+    void finishSave(bool succeeded);
+
+    qint64 snapshotSize() const { return m_snapshotSize; }
+    qint64 storedSnapshotSize() const { return m_storedSnapshotSize; }
+    qint64 journalSize() const { return m_journalSize; }
+
+    static QVector<Chunk> splitChunks(const QByteArray &data);
+    static QByteArray makeDelta(const QByteArray &base, const QMultiHash<uint, Chunk> &baseIndex,
+                                const QByteArray &data, const QVector<Chunk> &dataChunks);
+    static bool applyDelta(const QByteArray &base, const QByteArray &delta, QByteArray *output);
+    static QByteArray packSnapshot(const QByteArray &state, quint32 stateChecksum, Codec codec, int level);
+    static QByteArray packBlob(const QByteArray &data, Codec codec, int level);
+    static bool unpackBlob(const QByteArray &data, QByteArray *output);
+    static quint32 checksum(const QByteArray &data);
+    static QByteArray encode(const QByteArray &data, Codec codec, int level);
+    static bool codecFromName(const QString &name, Codec *codec);
+
+protected:
+    enum Repair {
+        RepairNone,
+        RepairRemoveJournal,
+        RepairTruncateJournal,
+        RepairCompact,
+    };
+
+    const SectionEntry *findSection(quint32 id) const;
+    bool decodeSection(const SectionEntry &entry, QByteArray *output) const;
+    bool needsCompaction(int deltaSize) const;
+    void prepareSnapshot(const QByteArray &state, MorseStorageBatch *batch);
+    void prepareSnapshot(const QByteArray &state, MorseStorageBatch *batch, const QVector<Chunk> &chunks);
+    QByteArray makeJournalHeader() const;
+    QByteArray makeRecord(const QByteArray &delta) const;
+    void resetBase(const QByteArray &state, const QVector<Chunk> &chunks);
+
+    QString m_snapshotFileName;
+    QString m_journalFileName;
+    bool m_journalEnabled = true;
+    Codec m_codec = CodecZlib;
+    int m_compressionLevel = -1;
+
+    QFile m_mappedFile;
+    uchar *m_mappedData = nullptr;
+    qint64 m_mappedSize = 0;
+    QVector<SectionEntry> m_sections; // Empty for the legacy single-blob snapshot
+
+    QByteArray m_base; // The last written state
+    QMultiHash<uint, Chunk> m_baseIndex; // Chunk hash to the chunk position in m_base
+    quint32 m_snapshotChecksum = 0;
+    qint64 m_snapshotSize = 0; // Decoded
+    qint64 m_storedSnapshotSize = 0; // On the disk
+    qint64 m_journalSize = 0;
+    int m_journalRecords = 0;
+    Repair m_repair = RepairNone; // Found by load()
+    qint64 m_repairJournalSize = 0;
+
+    // The state written by the batch in flight
+    QByteArray m_pendingState;
+    quint32 m_pendingChecksum = 0;
+    qint64 m_pendingStoredSize = 0;
+    QVector<Chunk> m_pendingChunks;
+    qint64 m_pendingRecordSize = 0;
+    bool m_pendingSnapshot = false;
+};
+
+#endif // MORSE_STATE_JOURNAL_HPP
@@ -0,0 +1,379 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "storagewriter.hpp"
+#include "logging.hpp"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+#include <stdio.h>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const int c_maxPendingTasks = 32;
+static const QString c_temporaryFileSuffix = QLatin1String(".tmp");
+
+static bool syncFileData(QFile *file)
+{
+    if (!file->flush()) {
+        return false;
+    }
+#if defined(Q_OS_LINUX)
+    return ::fdatasync(file->handle()) == 0;
+#elif defined(Q_OS_UNIX)
+    return ::fsync(file->handle()) == 0;
+#else
+    return true;
+#endif
+}
+
+void MorseStorageBatch::replaceFile(const QString &fileName, const QByteArray &data)
+{
+    Operation operation;
+    operation.type = OperationReplace;
+    operation.fileName = fileName;
+    operation.data = data;
+    m_operations.append(operation);
+}
+
+void MorseStorageBatch::appendFile(const QString &fileName, const QByteArray &data)
+{
+    Operation operation;
+    operation.type = OperationAppend;
+    operation.fileName = fileName;
+    operation.data = data;
+    m_operations.append(operation);
+}
+
+void MorseStorageBatch::removeFile(const QString &fileName)
+{
+    Operation operation;
+    operation.type = OperationRemove;
+    operation.fileName = fileName;
+    m_operations.append(operation);
+}
+
+void MorseStorageBatch::truncateFile(const QString &fileName, qint64 size)
+{
+    Operation operation;
+    operation.type = OperationTruncate;
+    operation.fileName = fileName;
+    operation.initialSize = size;
+    m_operations.append(operation);
+}
+
+qint64 MorseStorageBatch::bytesToWrite() const
+{
+    qint64 result = 0;
+    for (const Operation &operation : m_operations) {
+        result += operation.data.size();
+    }
+    return result;
+}
+
+bool MorseStorageBatch::write()
+{
+    for (Operation &operation : m_operations) {
+        switch (operation.type) {
+        case OperationReplace:
+            operation.file = QSharedPointer<QFile>::create(operation.fileName + c_temporaryFileSuffix);
+            if (!operation.file->open(QIODevice::WriteOnly|QIODevice::Truncate)) {
+                qCWarning(lcMorseStorage) << Q_FUNC_INFO << "Unable to open" << operation.file->fileName();
+                return false;
+            }
+            break;
+        case OperationAppend:
+            operation.file = QSharedPointer<QFile>::create(operation.fileName);
+            if (!operation.file->open(QIODevice::WriteOnly|QIODevice::Append)) {
+                qCWarning(lcMorseStorage) << Q_FUNC_INFO << "Unable to open" << operation.file->fileName();
+                return false;
+            }
+            operation.initialSize = operation.file->size();
+            break;
+        case OperationRemove:
+            continue;
+        case OperationTruncate:
+            operation.file = QSharedPointer<QFile>::create(operation.fileName);
+            if (!operation.file->open(QIODevice::ReadWrite) || !operation.file->resize(operation.initialSize)) {
+                qCWarning(lcMorseStorage) << Q_FUNC_INFO << "Unable to truncate" << operation.file->fileName();
+                return false;
+            }
+            continue;
+        }
+
+        if (operation.file->write(operation.data) != operation.data.size()) {
+            qCWarning(lcMorseStorage) << Q_FUNC_INFO << "Unable to write" << operation.file->fileName()
+                       << operation.file->errorString();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MorseStorageBatch::sync()
+{
+    for (Operation &operation : m_operations) {
+        if (!operation.file) {
+            continue;
+        }
+        if (!syncFileData(operation.file.data())) {
+            qCWarning(lcMorseStorage) << Q_FUNC_INFO << "Unable to sync" << operation.file->fileName();
+            return false;
+        }
+        operation.file->close();
+    }
+    return true;
+}
+
+bool MorseStorageBatch::commit(QSet<QString> *touchedDirectories)
+{
+    for (Operation &operation : m_operations) {
+        switch (operation.type) {
+        case OperationReplace: {
+            const QString temporaryFileName = operation.fileName + c_temporaryFileSuffix;
+            // QFile::rename() refuses to overwrite an existing file, while rename(2) replaces it atomically
+            if (::rename(QFile::encodeName(temporaryFileName).constData(),
+                         QFile::encodeName(operation.fileName).constData()) != 0) {
+                qCWarning(lcMorseStorage) << Q_FUNC_INFO << "Unable to rename" << temporaryFileName;
+                return false;
+            }
+            operation.file.clear();
+        }
+            break;
+        case OperationRemove:
+            QFile::remove(operation.fileName);
+            break;
+        case OperationAppend:
+        case OperationTruncate:
+            operation.file.clear();
+            break;
+        }
+        if (touchedDirectories) {
+            touchedDirectories->insert(QFileInfo(operation.fileName).absolutePath());
+        }
+    }
+    return true;
+}
+
+void MorseStorageBatch::abort()
+{
+    for (Operation &operation : m_operations) {
+        if (!operation.file) {
+            continue;
+        }
+        switch (operation.type) {
+        case OperationReplace:
+            operation.file->close();
+            operation.file->remove();
+            break;
+        case OperationAppend:
+            // Do not leave a partial record at the end of the file
+            operation.file->resize(operation.initialSize);
+            operation.file->close();
+            break;
+        case OperationTruncate:
+            // The dropped tail was invalid anyway
+            operation.file->close();
+            break;
+        case OperationRemove:
+            break;
+        }
+        operation.file.clear();
+    }
+}
+
+bool MorseStorageBatch::execute()
+{
+    QSet<QString> directories;
+    if (!write() || !sync() || !commit(&directories)) {
+        abort();
+        return false;
+    }
+    for (const QString &directory : directories) {
+        syncDirectory(directory);
+    }
+    return true;
+}
+
+bool MorseStorageBatch::syncDirectory(const QString &path)
+{
+#ifdef Q_OS_UNIX
+    // Make the renames and removals durable
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY|O_DIRECTORY);
+    if (fd < 0) {
+        return false;
+    }
+    const bool result = ::fsync(fd) == 0;
+    ::close(fd);
+    return result;
+#else
+    Q_UNUSED(path)
+    return true;
+#endif
+}
+
+MorseStorageWriter *MorseStorageWriter::instance()
+{
+    static MorseStorageWriter *writer = nullptr;
+    if (!writer) {
+        writer = new MorseStorageWriter(QCoreApplication::instance());
+        // Finish the pending writes before the application exits
+        connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, writer, &MorseStorageWriter::stop);
+        writer->start(QThread::LowPriority);
+    }
+    return writer;
+}
+
+MorseStorageWriter::MorseStorageWriter(QObject *parent) :
+    QThread(parent)
+{
+    setObjectName(QStringLiteral("MorseStorageWriter"));
+}
+
+MorseStorageWriter::~MorseStorageWriter()
+{
+    stop();
+}
+
+void MorseStorageWriter::enqueue(const QString &key, const Task &task)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_tasks.contains(key)) {
+        // Coalesce with the pending save of the same account
+        m_tasks.insert(key, task);
+        return;
+    }
+
+    while ((m_queue.count() >= c_maxPendingTasks) && !m_stopRequested) {
+        m_queueAvailable.wait(&m_mutex);
+    }
+
+    if (!m_stopRequested) {
+        m_tasks.insert(key, task);
+        m_queue.append(key);
+        m_taskAvailable.wakeOne();
+        return;
+    }
+
+    // The thread does not take new tasks once stopped, so write in place after the pending tasks
+    locker.unlock();
+    wait();
+    runTask(key, task);
+}
+
+void MorseStorageWriter::runTask(const QString &key, const Task &task)
+{
+    MorseStorageBatch batch;
+    const bool succeeded = task.prepare(&batch) && batch.execute();
+    if (task.finish) {
+        task.finish(succeeded);
+    }
+    emit taskFinished(key, succeeded);
+}
+
+bool MorseStorageWriter::waitForIdle(unsigned long time)
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_busy || !m_queue.isEmpty()) {
+        if (!m_idle.wait(&m_mutex, time)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void MorseStorageWriter::stop()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopRequested = true;
+        m_taskAvailable.wakeAll();
+        m_queueAvailable.wakeAll();
+    }
+    wait();
+}
+
+void MorseStorageWriter::run()
+{
+    forever {
+        QStringList keys;
+        QVector<Task> tasks;
+        {
+            QMutexLocker locker(&m_mutex);
+            m_busy = false;
+            while (m_queue.isEmpty()) {
+                m_idle.wakeAll();
+                if (m_stopRequested) {
+                    return;
+                }
+                m_taskAvailable.wait(&m_mutex);
+            }
+            keys.swap(m_queue);
+            tasks.reserve(keys.count());
+            for (const QString &key : keys) {
+                tasks.append(m_tasks.take(key));
+            }
+            m_busy = true;
+            m_queueAvailable.wakeAll();
+        }
+
+        const int count = tasks.count();
+        QVector<MorseStorageBatch> batches(count);
+        QVector<bool> results(count);
+
+        for (int i = 0; i < count; ++i) {
+            results[i] = tasks.at(i).prepare(&batches[i]) && batches[i].write();
+        }
+
+        // Sync all files of the batch in a row and only then make them visible
+        for (int i = 0; i < count; ++i) {
+            if (results.at(i)) {
+                results[i] = batches[i].sync();
+            }
+        }
+
+        QSet<QString> directories;
+        for (int i = 0; i < count; ++i) {
+            if (results.at(i)) {
+                results[i] = batches[i].commit(&directories);
+            }
+            if (!results.at(i)) {
+                batches[i].abort();
+            }
+        }
+        for (const QString &directory : directories) {
+            MorseStorageBatch::syncDirectory(directory);
+        }
+
+        for (int i = 0; i < count; ++i) {
+            if (tasks.at(i).finish) {
+                tasks.at(i).finish(results.at(i));
+            }
+            emit taskFinished(keys.at(i), results.at(i));
+        }
+    }
+}
@@ -0,0 +1,132 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MORSE_STORAGE_WRITER_HPP
+#define MORSE_STORAGE_WRITER_HPP
+
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+#include <climits>
+#include <functional>
+
+QT_FORWARD_DECLARE_CLASS(QFile)
+
+/**
+ * A set of file operations committed together.
+ *
+ * The replaced files are written to a temporary file first and renamed over the target
+ * only after the data is synced to the disk, so a crash leaves either the old or the new
+ * version of the file. The operations are executed in phases (write, sync, commit) to let
+ * the writer thread batch the syncs of several accounts.
+ */
+class MorseStorageBatch
+{
+public:
+    void replaceFile(const QString &fileName, const QByteArray &data);
+    void appendFile(const QString &fileName, const QByteArray &data);
+    void removeFile(const QString &fileName);
+    void truncateFile(const QString &fileName, qint64 size);
+
+    bool isEmpty() const { return m_operations.isEmpty(); }
+    qint64 bytesToWrite() const;
+
+    bool write();
+    bool sync();
+    bool commit(QSet<QString> *touchedDirectories);
+    void abort();
+
+    bool execute();
+
+    static bool syncDirectory(const QString &path);
+
+protected:
+    enum OperationType {
+        OperationReplace,
+        OperationAppend,
+        OperationRemove,
+        OperationTruncate,
+    };
+
+    struct Operation
+    {
+        OperationType type;
+        QString fileName;
+        QByteArray data;
+        QSharedPointer<QFile> file;
+        qint64 initialSize = 0; // The target size for OperationTruncate
+    };
+
+    QVector<Operation> m_operations;
+};
+
+/**
+ * Process-wide I/O thread for the persistent state.
+ *
+ * The tasks are keyed (usually by the account data directory). A task enqueued for a key
+ * which already has a pending task replaces it, so only the latest state of an account is
+ * written. The queue is bounded; enqueue() blocks if it is full. Once the writer is stopped
+ * (on the application exit), enqueue() executes the task in the calling thread.
+ *
+ * The writer takes all pending tasks at once, prepares their batches and syncs them together.
+ */
+class MorseStorageWriter : public QThread
+{
+    Q_OBJECT
+public:
+    struct Task
+    {
+        std::function<bool(MorseStorageBatch *batch)> prepare; // Called in the writer thread (see enqueue())
+        std::function<void(bool succeeded)> finish; // Called in the writer thread (see enqueue())
+    };
+
+    static MorseStorageWriter *instance();
+
+    void enqueue(const QString &key, const Task &task);
+    bool waitForIdle(unsigned long time = ULONG_MAX);
+
+signals:
+    void taskFinished(const QString &key, bool succeeded);
+
+protected:
+    explicit MorseStorageWriter(QObject *parent = nullptr);
+    ~MorseStorageWriter() override;
+
+    void run() override;
+    void stop();
+    void runTask(const QString &key, const Task &task);
+
+    QMutex m_mutex;
+    QWaitCondition m_taskAvailable;
+    QWaitCondition m_queueAvailable;
+    QWaitCondition m_idle;
+
+    QHash<QString, Task> m_tasks;
+    QStringList m_queue; // Keys in the submission order
+    bool m_busy = false;
+    bool m_stopRequested = false;
+};
+
+#endif // MORSE_STORAGE_WRITER_HPP
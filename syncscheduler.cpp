@@ -0,0 +1,235 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "syncscheduler.hpp"
+#include "logging.hpp"
+
+#include <TelegramQt/MessagingApi>
+#include <TelegramQt/PendingOperation>
+
+#include <QDebug>
+#include <QTimer>
+
+#include <algorithm>
+
+static const int c_idleSyncDelay = 5000; // ms without sync activity before the deferred dialogs are synced
+static const int c_syncTimeout = 30000; // ms to wait for the sync to finish before giving up the slot
+
+MorseSyncScheduler::MorseSyncScheduler(Telegram::Client::MessagingApi *api, QObject *parent) :
+    QObject(parent),
+    m_api(api),
+    m_idleTimer(new QTimer(this)),
+    m_expireTimer(new QTimer(this))
+{
+    m_idleTimer->setSingleShot(true);
+    m_idleTimer->setInterval(c_idleSyncDelay);
+    connect(m_idleTimer, &QTimer::timeout, this, &MorseSyncScheduler::onIdleTimeout);
+
+    m_expireTimer->setInterval(c_syncTimeout / 2);
+    connect(m_expireTimer, &QTimer::timeout, this, &MorseSyncScheduler::expireActiveSyncs);
+}
+
+void MorseSyncScheduler::setSyncLimit(int limit)
+{
+    m_syncLimit = qMax(1, limit);
+}
+
+void MorseSyncScheduler::setMaxSyncLimit(int limit)
+{
+    m_maxSyncLimit = qMax(1, limit);
+}
+
+void MorseSyncScheduler::setImmediateCount(int count)
+{
+    m_immediateCount = qMax(0, count);
+}
+
+void MorseSyncScheduler::setConcurrency(int concurrency)
+{
+    m_concurrency = qMax(1, concurrency);
+}
+
+void MorseSyncScheduler::schedule(QVector<Dialog> dialogs)
+{
+    // Unread dialogs first, then the most recently active ones
+    std::stable_sort(dialogs.begin(), dialogs.end(), [](const Dialog &left, const Dialog &right) {
+        if ((left.unreadCount > 0) != (right.unreadCount > 0)) {
+            return left.unreadCount > 0;
+        }
+        return left.rank < right.rank;
+    });
+
+    m_pending.clear();
+    m_pending.reserve(dialogs.count());
+    m_idle = false;
+    for (int i = 0; i < dialogs.count(); ++i) {
+        if (m_active.contains(dialogs.at(i).peer)) {
+            continue;
+        }
+        PendingDialog pending;
+        pending.dialog = dialogs.at(i);
+        pending.deferred = i >= m_immediateCount;
+        m_pending.append(pending);
+    }
+
+    startSyncs();
+}
+
+/**
+ * Sync the \a peer as soon as possible (e.g. because its channel is opened).
+ */
+void MorseSyncScheduler::prioritize(const Telegram::Peer &peer)
+{
+    const auto it = std::find_if(m_pending.begin(), m_pending.end(), [&peer](const PendingDialog &pending) {
+        return pending.dialog.peer == peer;
+    });
+    if (it == m_pending.end()) {
+        return;
+    }
+    PendingDialog pending = *it;
+    pending.deferred = false;
+    m_pending.erase(it);
+    m_pending.prepend(pending);
+    // The requested channel has priority over the deferred dialogs
+    m_idle = false;
+
+    startSyncs();
+}
+
+void MorseSyncScheduler::clear()
+{
+    m_pending.clear();
+    m_active.clear();
+    m_idleTimer->stop();
+    m_expireTimer->stop();
+    m_idle = false;
+}
+
+void MorseSyncScheduler::onPeerSynced(const Telegram::Peer &peer)
+{
+    if (!m_active.remove(peer)) {
+        return;
+    }
+    startSyncs();
+}
+
+int MorseSyncScheduler::syncLimit(const Dialog &dialog) const
+{
+    return qBound(m_syncLimit, dialog.unreadCount, m_maxSyncLimit);
+}
+
+void MorseSyncScheduler::startSyncs()
+{
+    QVector<PendingDialog> batch;
+    int batchLimit = m_activeLimit;
+    while (!m_pending.isEmpty()) {
+        const bool deferred = m_pending.first().deferred;
+        if (deferred && !m_idle) {
+            break;
+        }
+        // Run a single deferred sync at a time to leave the link to the interactive traffic
+        const int concurrency = deferred ? 1 : m_concurrency;
+        if (m_active.count() + batch.count() >= concurrency) {
+            break;
+        }
+        const int limit = syncLimit(m_pending.first().dialog);
+        if ((!m_active.isEmpty() || !batch.isEmpty()) && (limit != batchLimit)) {
+            // The limit is global, so wait for the running syncs first
+            break;
+        }
+        batchLimit = limit;
+        if (!deferred) {
+            m_idle = false;
+        }
+        batch.append(m_pending.takeFirst());
+    }
+    if (!batch.isEmpty()) {
+        startSync(batch, batchLimit);
+    }
+
+    if (m_active.isEmpty()) {
+        m_expireTimer->stop();
+        if (!m_pending.isEmpty() && !m_idle) {
+            m_idleTimer->start();
+        }
+    } else {
+        m_idleTimer->stop();
+        if (!m_expireTimer->isActive()) {
+            m_expireTimer->start();
+        }
+    }
+}
+
+void MorseSyncScheduler::startSync(const QVector<PendingDialog> &dialogs, int limit)
+{
+    const quint64 request = ++m_lastRequest;
+    QVector<Telegram::Peer> peers;
+    peers.reserve(dialogs.count());
+    for (const PendingDialog &pending : dialogs) {
+        qCDebug(lcMorseChannel) << Q_FUNC_INFO << pending.dialog.peer.toString() << "limit" << limit
+                 << (pending.deferred ? "(deferred)" : "");
+        ActiveSync &sync = m_active[pending.dialog.peer];
+        sync.timer.start();
+        sync.request = request;
+        peers.append(pending.dialog.peer);
+    }
+
+    m_activeLimit = limit;
+    m_api->setSyncLimit(limit);
+    Telegram::Client::PendingOperation *operation = m_api->syncPeers(peers);
+    // A peer without new messages gets no syncMessages(), so free the slots once the request is done
+    connect(operation, &Telegram::Client::PendingOperation::finished, this, [this, peers, request]() {
+        onSyncFinished(peers, request);
+    });
+}
+
+void MorseSyncScheduler::onSyncFinished(const QVector<Telegram::Peer> &peers, quint64 request)
+{
+    bool changed = false;
+    for (const Telegram::Peer &peer : peers) {
+        const auto it = m_active.find(peer);
+        // The peer may be synced again by a newer request
+        if ((it != m_active.end()) && (it->request == request)) {
+            m_active.erase(it);
+            changed = true;
+        }
+    }
+    if (changed) {
+        startSyncs();
+    }
+}
+
+void MorseSyncScheduler::onIdleTimeout()
+{
+    m_idle = true;
+    startSyncs();
+}
+
+void MorseSyncScheduler::expireActiveSyncs()
+{
+    for (auto it = m_active.begin(); it != m_active.end(); ) {
+        if (it->timer.hasExpired(c_syncTimeout)) {
+            // Do not let a stuck request hold the slot
+            it = m_active.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    startSyncs();
+}
@@ -0,0 +1,124 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MORSE_SYNC_SCHEDULER_HPP
+#define MORSE_SYNC_SCHEDULER_HPP
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QVector>
+
+#include <TelegramQt/TelegramNamespace>
+
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
+namespace Telegram {
+
+namespace Client {
+
+class MessagingApi;
+
+} // Client namespace
+
+} // Telegram namespace
+
+/**
+ * History sync queue.
+ *
+ * The dialogs are ranked by the unread messages and then by the dialog list position.
+ * The top immediateCount() dialogs are synced right away; the rest are deferred until
+ * their channel is requested (see prioritize()) or until there was no sync activity
+ * for 5 seconds. The idle state ends with the next non-deferred sync; the link usage
+ * outside of the sync is not taken into account.
+ * At most concurrency() peers are synced at once. The per-peer history limit follows
+ * the unread count, bounded by syncLimit() and maxSyncLimit(). The API limit is global,
+ * so the peers sharing a limit are synced by a single request, and a different limit is
+ * applied only once the running syncs are finished.
+ */
+class MorseSyncScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    struct Dialog
+    {
+        Telegram::Peer peer;
+        int unreadCount = 0;
+        int rank = 0; // Position in the dialog list
+    };
+
+    explicit MorseSyncScheduler(Telegram::Client::MessagingApi *api, QObject *parent = nullptr);
+
+    int syncLimit() const { return m_syncLimit; }
+    void setSyncLimit(int limit);
+
+    int maxSyncLimit() const { return m_maxSyncLimit; }
+    void setMaxSyncLimit(int limit);
+
+    int immediateCount() const { return m_immediateCount; }
+    void setImmediateCount(int count);
+
+    int concurrency() const { return m_concurrency; }
+    void setConcurrency(int concurrency);
+
+    int pendingCount() const { return m_pending.count(); }
+    int activeCount() const { return m_active.count(); }
+
+    void schedule(QVector<Dialog> dialogs);
+    void prioritize(const Telegram::Peer &peer);
+    void clear();
+
+public slots:
+    void onPeerSynced(const Telegram::Peer &peer);
+
+protected:
+    struct PendingDialog
+    {
+        Dialog dialog;
+        bool deferred = false;
+    };
+
+    struct ActiveSync
+    {
+        QElapsedTimer timer; // Since the sync start
+        quint64 request = 0;
+    };
+
+    int syncLimit(const Dialog &dialog) const;
+    void startSyncs();
+    void startSync(const QVector<PendingDialog> &dialogs, int limit);
+    void onSyncFinished(const QVector<Telegram::Peer> &peers, quint64 request);
+    void onIdleTimeout();
+    void expireActiveSyncs();
+
+    Telegram::Client::MessagingApi *m_api = nullptr;
+    QVector<PendingDialog> m_pending; // Ordered by priority
+    QHash<Telegram::Peer, ActiveSync> m_active;
+    QTimer *m_idleTimer = nullptr;
+    QTimer *m_expireTimer = nullptr;
+    int m_syncLimit = 30;
+    int m_maxSyncLimit = 200;
+    int m_immediateCount = 10;
+    int m_concurrency = 4;
+    int m_activeLimit = 0; // The API limit of the running syncs
+    quint64 m_lastRequest = 0;
+    bool m_idle = false; // No non-deferred sync since the idle timeout
+};
+
+#endif // MORSE_SYNC_SCHEDULER_HPP
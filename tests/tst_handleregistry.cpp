@@ -0,0 +1,157 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "handleregistry.hpp"
+
+#include <QTest>
+
+class tst_MorseHandleRegistry : public QObject
+{
+    Q_OBJECT
+private slots:
+    void sequentialHandles();
+    void invalidPeer();
+    void unknownHandle();
+    void setPeer();
+    void serialization();
+    void duplicatedPeers();
+    void revision();
+};
+
+void tst_MorseHandleRegistry::sequentialHandles()
+{
+    MorseHandleRegistry registry;
+    const Telegram::Peer alice = Telegram::Peer::fromUserId(1001);
+    const Telegram::Peer bob = Telegram::Peer::fromUserId(1002);
+
+    QCOMPARE(registry.ensureHandle(alice), 1u);
+    QCOMPARE(registry.ensureHandle(bob), 2u);
+    QCOMPARE(registry.ensureHandle(alice), 1u);
+    QCOMPARE(registry.count(), 2);
+    QCOMPARE(registry.lastHandle(), 2u);
+
+    QCOMPARE(registry.handle(bob), 2u);
+    QCOMPARE(registry.peer(1), alice);
+    QCOMPARE(registry.peer(2), bob);
+}
+
+void tst_MorseHandleRegistry::invalidPeer()
+{
+    MorseHandleRegistry registry;
+    QCOMPARE(registry.ensureHandle(Telegram::Peer()), 0u);
+    QVERIFY(registry.isEmpty());
+}
+
+void tst_MorseHandleRegistry::unknownHandle()
+{
+    MorseHandleRegistry registry;
+    registry.ensureHandle(Telegram::Peer::fromUserId(1001));
+
+    QVERIFY(!registry.contains(0));
+    QVERIFY(registry.contains(1));
+    QVERIFY(!registry.contains(2));
+    QVERIFY(!registry.peer(0).isValid());
+    QVERIFY(!registry.peer(2).isValid());
+    QCOMPARE(registry.handle(Telegram::Peer::fromUserId(1002)), 0u);
+}
+
+void tst_MorseHandleRegistry::setPeer()
+{
+    MorseHandleRegistry registry;
+    const Telegram::Peer self = Telegram::Peer::fromUserId(1001);
+    const Telegram::Peer other = Telegram::Peer::fromUserId(1002);
+
+    // A reserved handle beyond the table leaves a gap
+    registry.setPeer(3, self);
+    QCOMPARE(registry.lastHandle(), 3u);
+    QVERIFY(!registry.peer(1).isValid());
+    QCOMPARE(registry.handle(self), 3u);
+
+    // The next allocation goes after the reserved handle
+    QCOMPARE(registry.ensureHandle(other), 4u);
+
+    // Rebinding drops the previous peer of the handle
+    const Telegram::Peer newSelf = Telegram::Peer::fromUserId(1003);
+    registry.setPeer(3, newSelf);
+    QCOMPARE(registry.peer(3), newSelf);
+    QCOMPARE(registry.handle(newSelf), 3u);
+    QCOMPARE(registry.handle(self), 0u);
+}
+
+void tst_MorseHandleRegistry::serialization()
+{
+    MorseHandleRegistry registry;
+    registry.ensureHandle(Telegram::Peer::fromUserId(1001));
+    registry.setPeer(3, Telegram::Peer::fromChatId(2001));
+
+    const QStringList list = registry.toStringList();
+    QCOMPARE(list.count(), 3);
+    QVERIFY(list.at(1).isEmpty());
+
+    MorseHandleRegistry restored;
+    restored.fromStringList(list);
+    QCOMPARE(restored.lastHandle(), 3u);
+    QCOMPARE(restored.peer(1), Telegram::Peer::fromUserId(1001));
+    QVERIFY(!restored.peer(2).isValid());
+    QCOMPARE(restored.peer(3), Telegram::Peer::fromChatId(2001));
+    QCOMPARE(restored.handle(Telegram::Peer::fromChatId(2001)), 3u);
+    QCOMPARE(restored.toStringList(), list);
+}
+
+void tst_MorseHandleRegistry::duplicatedPeers()
+{
+    const Telegram::Peer peer = Telegram::Peer::fromUserId(1001);
+
+    MorseHandleRegistry registry;
+    registry.fromStringList({ peer.toString(), peer.toString(), Telegram::Peer::fromUserId(1002).toString() });
+
+    // The first handle wins and the duplicate becomes a gap, so the other handles keep their values
+    QCOMPARE(registry.lastHandle(), 3u);
+    QCOMPARE(registry.handle(peer), 1u);
+    QVERIFY(!registry.peer(2).isValid());
+    QCOMPARE(registry.handle(Telegram::Peer::fromUserId(1002)), 3u);
+}
+
+void tst_MorseHandleRegistry::revision()
+{
+    MorseHandleRegistry registry;
+    const Telegram::Peer peer = Telegram::Peer::fromUserId(1001);
+
+    quint64 revision = registry.revision();
+    registry.ensureHandle(peer);
+    QVERIFY(registry.revision() != revision);
+
+    // Lookups and known peers do not modify the table
+    revision = registry.revision();
+    registry.ensureHandle(peer);
+    registry.handle(peer);
+    registry.peer(1);
+    QCOMPARE(registry.revision(), revision);
+
+    registry.setPeer(2, Telegram::Peer::fromUserId(1002));
+    QVERIFY(registry.revision() != revision);
+
+    revision = registry.revision();
+    registry.clear();
+    QVERIFY(registry.revision() != revision);
+}
+
+QTEST_APPLESS_MAIN(tst_MorseHandleRegistry)
+
+#include "tst_handleregistry.moc"
@@ -0,0 +1,189 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "metrics.hpp"
+
+#include <QTest>
+#include <QVariantList>
+
+#include <limits>
+
+class tst_MorseMetrics : public QObject
+{
+    Q_OBJECT
+private slots:
+    void linearBuckets();
+    void bucketBounds();
+    void relativeError();
+    void percentiles_data();
+    void percentiles();
+    void emptyHistogram();
+    void variantMap();
+    void reset();
+    void counters();
+};
+
+void tst_MorseMetrics::linearBuckets()
+{
+    for (int value = 0; value < MorseHistogram::LinearCount; ++value) {
+        QCOMPARE(MorseHistogram::bucketIndex(quint64(value)), value);
+        QCOMPARE(MorseHistogram::bucketUpperBound(value), quint64(value));
+    }
+    QCOMPARE(MorseHistogram::bucketIndex(MorseHistogram::LinearCount), int(MorseHistogram::LinearCount));
+}
+
+void tst_MorseMetrics::bucketBounds()
+{
+    // The buckets are contiguous: each one starts right after the previous upper bound
+    quint64 lower = 0;
+    for (int index = 0; index < MorseHistogram::BucketCount; ++index) {
+        const quint64 upper = MorseHistogram::bucketUpperBound(index);
+        QVERIFY2(upper >= lower, qPrintable(QStringLiteral("bucket %1").arg(index)));
+        QCOMPARE(MorseHistogram::bucketIndex(lower), index);
+        QCOMPARE(MorseHistogram::bucketIndex(upper), index);
+        if (index + 1 < MorseHistogram::BucketCount) {
+            QCOMPARE(MorseHistogram::bucketIndex(upper + 1), index + 1);
+        }
+        lower = upper + 1;
+    }
+
+    // The last bucket ends exactly at the largest value
+    QCOMPARE(MorseHistogram::bucketUpperBound(MorseHistogram::BucketCount - 1), std::numeric_limits<quint64>::max());
+    QCOMPARE(MorseHistogram::bucketIndex(std::numeric_limits<quint64>::max()), MorseHistogram::BucketCount - 1);
+
+    QCOMPARE(MorseHistogram::bucketIndex(16), 16);
+    QCOMPARE(MorseHistogram::bucketIndex(17), 16);
+    QCOMPARE(MorseHistogram::bucketIndex(18), 17);
+    QCOMPARE(MorseHistogram::bucketUpperBound(16), quint64(17));
+    QCOMPARE(MorseHistogram::bucketUpperBound(17), quint64(19));
+}
+
+void tst_MorseMetrics::relativeError()
+{
+    // A value reported as its bucket upper bound is off by less than 12.5%
+    for (int index = MorseHistogram::LinearCount; index < MorseHistogram::BucketCount; ++index) {
+        const quint64 lower = MorseHistogram::bucketUpperBound(index - 1) + 1;
+        const quint64 upper = MorseHistogram::bucketUpperBound(index);
+        QVERIFY2((upper - lower) * 8 < lower, qPrintable(QStringLiteral("bucket %1").arg(index)));
+    }
+}
+
+void tst_MorseMetrics::percentiles_data()
+{
+    QTest::addColumn<double>("fraction");
+    QTest::addColumn<quint64>("expected");
+
+    QTest::newRow("min") << 0.0 << quint64(1);
+    QTest::newRow("p50") << 0.5 << quint64(500);
+    QTest::newRow("p90") << 0.9 << quint64(900);
+    QTest::newRow("p99") << 0.99 << quint64(990);
+    QTest::newRow("max") << 1.0 << quint64(1000);
+}
+
+void tst_MorseMetrics::percentiles()
+{
+    QFETCH(double, fraction);
+    QFETCH(quint64, expected);
+
+    MorseHistogram histogram;
+    for (quint64 value = 1; value <= 1000; ++value) {
+        histogram.record(value);
+    }
+    QCOMPARE(histogram.count(), quint64(1000));
+    QCOMPARE(histogram.sum(), quint64(500500));
+    QCOMPARE(histogram.max(), quint64(1000));
+
+    // Never below the exact value, never above the recorded maximum
+    const quint64 value = histogram.percentile(fraction);
+    QVERIFY2((value >= expected) && ((value - expected) * 8 < expected) && (value <= histogram.max()),
+             qPrintable(QStringLiteral("%1 for the expected %2").arg(value).arg(expected)));
+}
+
+void tst_MorseMetrics::emptyHistogram()
+{
+    MorseHistogram histogram;
+    QCOMPARE(histogram.count(), quint64(0));
+    QCOMPARE(histogram.percentile(0.5), quint64(0));
+
+    const QVariantMap map = histogram.toVariantMap();
+    QCOMPARE(map.value(QStringLiteral("count")).toULongLong(), quint64(0));
+    QCOMPARE(map.value(QStringLiteral("mean")).toDouble(), 0.0);
+    QVERIFY(map.value(QStringLiteral("bucket-bounds")).toList().isEmpty());
+}
+
+void tst_MorseMetrics::variantMap()
+{
+    MorseHistogram histogram;
+    histogram.record(3);
+    histogram.record(3);
+    histogram.record(100);
+
+    const QVariantMap map = histogram.toVariantMap();
+    QCOMPARE(map.value(QStringLiteral("count")).toULongLong(), quint64(3));
+    QCOMPARE(map.value(QStringLiteral("sum")).toULongLong(), quint64(106));
+    QCOMPARE(map.value(QStringLiteral("max")).toULongLong(), quint64(100));
+
+    // Only the non-empty buckets are reported
+    const QVariantList bounds = map.value(QStringLiteral("bucket-bounds")).toList();
+    const QVariantList counts = map.value(QStringLiteral("bucket-counts")).toList();
+    QCOMPARE(bounds.count(), 2);
+    QCOMPARE(counts.count(), 2);
+    QCOMPARE(bounds.at(0).toULongLong(), quint64(3));
+    QCOMPARE(counts.at(0).toULongLong(), quint64(2));
+    QCOMPARE(bounds.at(1).toULongLong(), MorseHistogram::bucketUpperBound(MorseHistogram::bucketIndex(100)));
+    QCOMPARE(counts.at(1).toULongLong(), quint64(1));
+}
+
+void tst_MorseMetrics::reset()
+{
+    MorseMetrics metrics;
+    metrics.record(MorseMetrics::SendLatency, 250);
+    metrics.increment(MorseMetrics::MessagesSent);
+    metrics.reset();
+
+    QCOMPARE(metrics.counter(MorseMetrics::MessagesSent), quint64(0));
+    const MorseHistogram &histogram = metrics.histogram(MorseMetrics::SendLatency);
+    QCOMPARE(histogram.count(), quint64(0));
+    QCOMPARE(histogram.sum(), quint64(0));
+    QCOMPARE(histogram.max(), quint64(0));
+    QCOMPARE(histogram.percentile(0.99), quint64(0));
+}
+
+void tst_MorseMetrics::counters()
+{
+    MorseMetrics metrics;
+    metrics.increment(MorseMetrics::MessagesReceived);
+    metrics.increment(MorseMetrics::MessagesReceived);
+    metrics.increment(MorseMetrics::BytesWritten, 4096);
+    QCOMPARE(metrics.counter(MorseMetrics::MessagesReceived), quint64(2));
+    QCOMPARE(metrics.counter(MorseMetrics::BytesWritten), quint64(4096));
+
+    const QVariantMap counters = metrics.counters();
+    QCOMPARE(counters.count(), int(MorseMetrics::CounterCount));
+    QCOMPARE(counters.value(QStringLiteral("messages-received")).toULongLong(), quint64(2));
+    QCOMPARE(counters.value(QStringLiteral("bytes-written")).toULongLong(), quint64(4096));
+    QCOMPARE(counters.value(QStringLiteral("avatar-cache-hits")).toULongLong(), quint64(0));
+
+    QCOMPARE(metrics.histograms().count(), int(MorseMetrics::HistogramCount));
+}
+
+QTEST_APPLESS_MAIN(tst_MorseMetrics)
+
+#include "tst_metrics.moc"
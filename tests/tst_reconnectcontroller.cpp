@@ -0,0 +1,130 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "reconnectcontroller.hpp"
+
+#include <QTest>
+
+#include <climits>
+
+static const int c_samples = 500;
+
+// Exposes the backoff of a given attempt
+class TestReconnectController : public MorseReconnectController
+{
+public:
+    int delay(int attempt)
+    {
+        m_attempt = attempt;
+        return nextDelay();
+    }
+};
+
+class tst_MorseReconnectController : public QObject
+{
+    Q_OBJECT
+private slots:
+    void delayBounds_data();
+    void delayBounds();
+    void firstAttempt();
+    void jitterSpread();
+    void setDelays();
+};
+
+void tst_MorseReconnectController::delayBounds_data()
+{
+    QTest::addColumn<int>("minimum");
+    QTest::addColumn<int>("maximum");
+
+    QTest::newRow("defaults") << 1000 << 60000;
+    QTest::newRow("short") << 1 << 10;
+    QTest::newRow("equal") << 5000 << 5000;
+    QTest::newRow("int max") << 1000 << INT_MAX;
+}
+
+void tst_MorseReconnectController::delayBounds()
+{
+    QFETCH(int, minimum);
+    QFETCH(int, maximum);
+
+    TestReconnectController controller;
+    controller.setDelays(minimum, maximum);
+
+    // Attempts far beyond the cap must neither overflow nor exceed the maximum
+    for (int attempt : { 0, 1, 2, 5, 10, 16, 17, 31, 32, 64, 1000, INT_MAX }) {
+        const qint64 expected = qMin<qint64>(maximum, qint64(minimum) << qMin(attempt, 16));
+        for (int i = 0; i < c_samples; ++i) {
+            const int delay = controller.delay(attempt);
+            QVERIFY2((delay >= expected - expected / 2) && (delay <= expected),
+                     qPrintable(QStringLiteral("attempt %1: %2 not in [%3, %4]")
+                                .arg(attempt).arg(delay).arg(expected - expected / 2).arg(expected)));
+            QVERIFY(delay <= maximum);
+            QVERIFY(delay > 0);
+        }
+    }
+}
+
+void tst_MorseReconnectController::firstAttempt()
+{
+    TestReconnectController controller;
+    QCOMPARE(controller.minimumDelay(), 1000);
+    QCOMPARE(controller.maximumDelay(), 60000);
+    for (int i = 0; i < c_samples; ++i) {
+        const int delay = controller.delay(0);
+        QVERIFY(delay >= 500);
+        QVERIFY(delay <= 1000);
+    }
+}
+
+void tst_MorseReconnectController::jitterSpread()
+{
+    // The clients reconnecting at once must not all pick the same delay
+    TestReconnectController controller;
+    int lowest = INT_MAX;
+    int highest = 0;
+    for (int i = 0; i < c_samples; ++i) {
+        const int delay = controller.delay(6);
+        lowest = qMin(lowest, delay);
+        highest = qMax(highest, delay);
+    }
+    QVERIFY(highest - lowest > 60000 / 4);
+}
+
+void tst_MorseReconnectController::setDelays()
+{
+    TestReconnectController controller;
+
+    controller.setDelays(0, 10);
+    QCOMPARE(controller.minimumDelay(), 1);
+    QCOMPARE(controller.maximumDelay(), 10);
+
+    // The maximum is never below the minimum
+    controller.setDelays(2000, 100);
+    QCOMPARE(controller.minimumDelay(), 2000);
+    QCOMPARE(controller.maximumDelay(), 2000);
+    for (int i = 0; i < c_samples; ++i) {
+        const int delay = controller.delay(3);
+        QVERIFY(delay >= 1000);
+        QVERIFY(delay <= 2000);
+    }
+}
+
+QTEST_GUILESS_MAIN(tst_MorseReconnectController)
+
+#include "tst_reconnectcontroller.moc"
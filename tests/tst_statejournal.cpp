@@ -0,0 +1,258 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "statejournal.hpp"
+#include "storagewriter.hpp"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QSharedPointer>
+#include <QTemporaryDir>
+#include <QTest>
+
+static const int c_stateSize = 256 * 1024;
+
+// Incompressible data, so the chunking is not helped by repeated content
+static QByteArray makeState(int size, quint32 seed)
+{
+    QByteArray result(size, Qt::Uninitialized);
+    quint32 state = seed;
+    for (char &byte : result) {
+        state = state * 1103515245u + 12345u;
+        byte = static_cast<char>(state >> 24);
+    }
+    return result;
+}
+
+// A small edit in the middle of the state, like a new message in the history
+static QByteArray editState(const QByteArray &state, const QByteArray &insertion)
+{
+    QByteArray result = state;
+    result.insert(result.size() / 2, insertion);
+    return result;
+}
+
+class tst_MorseStateJournal : public QObject
+{
+    Q_OBJECT
+private slots:
+    void init();
+    void deltaRoundTrip();
+    void rejectBrokenDelta();
+    void journaledSave();
+    void tornJournal();
+    void staleJournal();
+    void disabledJournal();
+
+protected:
+    void setupJournal(MorseStateJournal *journal) const;
+    bool repair(MorseStateJournal *journal) const;
+    QString snapshotFileName() const { return m_directory->filePath(QStringLiteral("state")); }
+    QString journalFileName() const { return m_directory->filePath(QStringLiteral("state.journal")); }
+
+    QSharedPointer<QTemporaryDir> m_directory;
+};
+
+void tst_MorseStateJournal::init()
+{
+    m_directory = QSharedPointer<QTemporaryDir>::create();
+    QVERIFY(m_directory->isValid());
+}
+
+void tst_MorseStateJournal::setupJournal(MorseStateJournal *journal) const
+{
+    journal->setSnapshotFileName(snapshotFileName());
+    journal->setJournalFileName(journalFileName());
+}
+
+bool tst_MorseStateJournal::repair(MorseStateJournal *journal) const
+{
+    MorseStorageBatch batch;
+    journal->prepareRepair(&batch);
+    const bool succeeded = batch.execute();
+    journal->finishRepair(succeeded);
+    return succeeded;
+}
+
+void tst_MorseStateJournal::deltaRoundTrip()
+{
+    const QByteArray base = makeState(c_stateSize, 1);
+    const QByteArray data = editState(base, QByteArrayLiteral("a new message"));
+
+    // An empty base index gives a delta of literals only
+    const QVector<MorseStateJournal::Chunk> chunks = MorseStateJournal::splitChunks(data);
+    const QByteArray delta = MorseStateJournal::makeDelta(base, QMultiHash<uint, MorseStateJournal::Chunk>(), data, chunks);
+    QByteArray output;
+    QVERIFY(MorseStateJournal::applyDelta(base, delta, &output));
+    QCOMPARE(output, data);
+
+    // The chunks cover the data without gaps
+    int offset = 0;
+    for (const MorseStateJournal::Chunk &chunk : chunks) {
+        QCOMPARE(chunk.offset, offset);
+        QVERIFY(chunk.size > 0);
+        offset += chunk.size;
+    }
+    QCOMPARE(offset, data.size());
+}
+
+void tst_MorseStateJournal::rejectBrokenDelta()
+{
+    const QByteArray base = makeState(1024, 1);
+    const QByteArray data = editState(base, QByteArrayLiteral("update"));
+    const QByteArray delta = MorseStateJournal::makeDelta(base, QMultiHash<uint, MorseStateJournal::Chunk>(),
+                                                          data, MorseStateJournal::splitChunks(data));
+    QByteArray output;
+    QVERIFY(!MorseStateJournal::applyDelta(base, delta.left(delta.size() - 1), &output));
+    QVERIFY(output.isEmpty());
+}
+
+void tst_MorseStateJournal::journaledSave()
+{
+    const QByteArray first = makeState(c_stateSize, 1);
+    const QByteArray second = editState(first, QByteArrayLiteral("a new message"));
+    {
+        MorseStateJournal journal;
+        setupJournal(&journal);
+        QVERIFY(journal.save(first));
+        QCOMPARE(journal.journalSize(), qint64(0));
+        QVERIFY(journal.save(second));
+        // The second save is a small delta record
+        QVERIFY(journal.journalSize() > 0);
+        QVERIFY(journal.journalSize() < c_stateSize / 8);
+    }
+
+    MorseStateJournal journal;
+    setupJournal(&journal);
+    QByteArray state;
+    QVERIFY(journal.load(&state));
+    QCOMPARE(state, second);
+    QVERIFY(!journal.needsRepair());
+}
+
+void tst_MorseStateJournal::tornJournal()
+{
+    const QByteArray first = makeState(c_stateSize, 1);
+    const QByteArray second = editState(first, QByteArrayLiteral("a new message"));
+    const QByteArray third = editState(second, QByteArrayLiteral("one more message"));
+    qint64 validJournalSize = 0;
+    {
+        MorseStateJournal journal;
+        setupJournal(&journal);
+        QVERIFY(journal.save(first));
+        QVERIFY(journal.save(second));
+        validJournalSize = QFileInfo(journalFileName()).size();
+        QVERIFY(journal.save(third));
+    }
+
+    // The process is killed in the middle of the last record
+    QFile journalFile(journalFileName());
+    QVERIFY(journalFile.size() > validJournalSize);
+    QVERIFY(journalFile.resize(journalFile.size() - 3));
+
+    MorseStateJournal journal;
+    setupJournal(&journal);
+    QByteArray state;
+    QVERIFY(journal.load(&state));
+    QCOMPARE(state, second);
+
+    // The load is read-only; the torn tail is dropped by the repair
+    QVERIFY(journal.needsRepair());
+    QVERIFY(QFileInfo(journalFileName()).size() > validJournalSize);
+    QVERIFY(repair(&journal));
+    QVERIFY(!journal.needsRepair());
+    QCOMPARE(QFileInfo(journalFileName()).size(), validJournalSize);
+
+    // The next record goes after the valid ones
+    QVERIFY(journal.save(third));
+    MorseStateJournal reloaded;
+    setupJournal(&reloaded);
+    QVERIFY(reloaded.load(&state));
+    QCOMPARE(state, third);
+    QVERIFY(!reloaded.needsRepair());
+}
+
+void tst_MorseStateJournal::staleJournal()
+{
+    const QByteArray first = makeState(c_stateSize, 1);
+    const QByteArray second = editState(first, QByteArrayLiteral("a new message"));
+    {
+        MorseStateJournal journal;
+        setupJournal(&journal);
+        QVERIFY(journal.save(first));
+        QVERIFY(journal.save(second));
+    }
+    QVERIFY(QFile::copy(journalFileName(), journalFileName() + QLatin1String(".old")));
+    {
+        // A compaction removes the journal and writes a new snapshot
+        MorseStateJournal journal;
+        setupJournal(&journal);
+        journal.setJournalEnabled(false);
+        QByteArray state;
+        QVERIFY(journal.load(&state));
+        QVERIFY(repair(&journal));
+    }
+    // The process is killed after the snapshot is replaced but before the journal is removed
+    QVERIFY(QFile::rename(journalFileName() + QLatin1String(".old"), journalFileName()));
+
+    MorseStateJournal journal;
+    setupJournal(&journal);
+    QByteArray state;
+    QVERIFY(journal.load(&state));
+    QCOMPARE(state, second);
+    QVERIFY(journal.needsRepair());
+    QVERIFY(repair(&journal));
+    QVERIFY(!QFile::exists(journalFileName()));
+}
+
+void tst_MorseStateJournal::disabledJournal()
+{
+    const QByteArray first = makeState(c_stateSize, 1);
+    const QByteArray second = editState(first, QByteArrayLiteral("a new message"));
+    {
+        MorseStateJournal journal;
+        setupJournal(&journal);
+        QVERIFY(journal.save(first));
+        QVERIFY(journal.save(second));
+    }
+
+    MorseStateJournal journal;
+    setupJournal(&journal);
+    journal.setJournalEnabled(false);
+    QByteArray state;
+    QVERIFY(journal.load(&state));
+    QCOMPARE(state, second);
+
+    // The journal left from the journaled mode is folded into the snapshot by the repair
+    QVERIFY(journal.needsRepair());
+    QVERIFY(QFile::exists(journalFileName()));
+    QVERIFY(repair(&journal));
+    QVERIFY(!QFile::exists(journalFileName()));
+
+    MorseStateJournal reloaded;
+    setupJournal(&reloaded);
+    reloaded.setJournalEnabled(false);
+    QVERIFY(reloaded.load(&state));
+    QCOMPARE(state, second);
+    QVERIFY(!reloaded.needsRepair());
+}
+
+QTEST_GUILESS_MAIN(tst_MorseStateJournal)
+
+#include "tst_statejournal.moc"
@@ -19,6 +19,9 @@
 
 #include "textchannel.hpp"
 #include "connection.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
+#include "watchdog.hpp"
 
 #include <TelegramQt/Client>
 #include <TelegramQt/DataStorage>
@@ -95,9 +98,6 @@ MorseTextChannel::MorseTextChannel(MorseConnection *morseConnection, Tp::BaseCha
     m_chatStateIface->setSetChatStateCallback(Tp::memFun(this, &MorseTextChannel::setChatState));
     baseChannel->plugInterface(Tp::AbstractChannelInterfacePtr::dynamicCast(m_chatStateIface));
 
-    connect(m_api, &Telegram::Client::MessagingApi::messageActionChanged,
-            this, &MorseTextChannel::onMessageActionChanged);
-
     Telegram::ChatInfo info;
     if (m_targetPeer.type() != Telegram::Peer::User) {
         m_client->dataStorage()->getChatInfo(&info, m_targetPeer);
@@ -147,6 +147,7 @@ MorseTextChannel::~MorseTextChannel()
 
 QString MorseTextChannel::sendMessageCallback(const Tp::MessagePartList &messageParts, uint flags, Tp::DBusError *error)
 {
+    MORSE_WATCHDOG_SCOPE();
     m_api->readHistory(m_targetPeer, m_dialogInfo.lastMessageId());
 
     QString content;
@@ -159,19 +160,26 @@ QString MorseTextChannel::sendMessageCallback(const Tp::MessagePartList &message
         }
     }
 
+    QElapsedTimer sendTimer;
+    sendTimer.start();
     quint64 tmpId = m_api->sendMessage(m_targetPeer, content);
+    PendingSend &pendingSend = m_pendingSends[m_nextPendingSend];
+    m_nextPendingSend = (m_nextPendingSend + 1) % int(sizeof(m_pendingSends) / sizeof(m_pendingSends[0]));
+    pendingSend.randomId = tmpId;
+    pendingSend.timer = sendTimer;
 
     return QString::number(tmpId);
 }
 
 void MorseTextChannel::messageAcknowledgedCallback(const QString &messageToken)
 {
+    MORSE_WATCHDOG_SCOPE();
     // Acknowledge != read. DO NOT mark the message as read here.
     // Clients acknowledge messages after they have actually stored them (or displayed to the user)
 
     const quint32 messageId = getMessageId(messageToken);
     if (!messageId) {
-        qWarning() << this << m_targetPeer << "invalid message token" << messageToken;
+        qCWarning(lcMorseChannel) << this << m_targetPeer << "invalid message token" << messageToken;
         return;
     }
 
@@ -188,16 +196,6 @@ quint32 MorseTextChannel::getMessageId(const QString &token) const
     return m_connection->getMessageId(m_targetPeer, token);
 }
 
-void MorseTextChannel::onMessageActionChanged(const Telegram::Peer &peer, quint32 userId, const Telegram::MessageAction &action)
-{
-    // We are connected to broadcast signal, so have to select only needed calls
-    const Telegram::Peer identifier = peer;
-    if (identifier != m_targetPeer) {
-        return;
-    }
-    setMessageAction(userId, action);
-}
-
 void MorseTextChannel::setMessageAction(quint32 userId, const Telegram::MessageAction &action)
 {
     const uint handle = m_connection->ensureContact(userId);
@@ -214,7 +212,10 @@ void MorseTextChannel::setMessageAction(quint32 userId, const Telegram::MessageA
 
 void MorseTextChannel::onMessageReceived(const Telegram::Message &message)
 {
+    MORSE_WATCHDOG_SCOPE();
+    MorseMessageTracer *tracer = m_connection->messageTracer();
     updateDialogInfo();
+    tracer->stamp(MorseMessageTracer::StageBuildParts);
 
     Tp::MessagePartList partList;
     Tp::MessagePart header;
@@ -296,6 +297,7 @@ void MorseTextChannel::onMessageReceived(const Telegram::Message &message)
     }
 
     if (message.type() != Telegram::Namespace::MessageTypeText) { // More, than a plain text message
+        tracer->stamp(MorseMessageTracer::StageMediaInfo);
         Telegram::MessageMediaInfo info;
         m_client->dataStorage()->getMessageMediaInfo(&info, message.peer(), message.id());
 
@@ -313,13 +315,13 @@ void MorseTextChannel::onMessageReceived(const Telegram::Message &message)
         case Telegram::Namespace::MessageTypeContact: {
             Telegram::UserInfo userInfo;
             if (!info.getContactInfo(&userInfo)) {
-                qWarning() << Q_FUNC_INFO << "Unable to get user info from contact media message" << message.id();
+                qCWarning(lcMorseChannel) << Q_FUNC_INFO << "Unable to get user info from contact media message" << message.id();
                 break;
             }
 
             QString data = userToVCard(userInfo);
             if (data.isEmpty()) {
-                qWarning() << Q_FUNC_INFO << "Unable to get user vcard from user info from message" << message.id();
+                qCWarning(lcMorseChannel) << Q_FUNC_INFO << "Unable to get user vcard from user info from message" << message.id();
                 break;
             }
             Tp::MessagePart userVCardPart;
@@ -388,6 +390,7 @@ void MorseTextChannel::onMessageReceived(const Telegram::Message &message)
     }
 
     partList << body;
+    tracer->stamp(MorseMessageTracer::StageAddReceivedMessage);
     addReceivedMessage(partList);
 }
 
@@ -400,28 +403,21 @@ void MorseTextChannel::updateChatParticipants(const Tp::UIntList &handles)
 #endif
 }
 
-void MorseTextChannel::onChatDetailsChanged(const Telegram::Peer &peer, const Tp::UIntList &handles)
+void MorseTextChannel::updateChatDetails(const Tp::UIntList &handles)
 {
-    qDebug() << Q_FUNC_INFO << peer;
+    qCDebug(lcMorseChannel) << Q_FUNC_INFO << m_targetPeer;
 
-    if (m_targetPeer == peer) {
-        updateChatParticipants(handles);
+    updateChatParticipants(handles);
 
-        Telegram::ChatInfo info;
-        if (m_client->dataStorage()->getChatInfo(&info, peer)) {
-            m_roomConfigIface->setTitle(info.title());
-            m_roomConfigIface->setConfigurationRetrieved(true);
-        }
+    Telegram::ChatInfo info;
+    if (m_roomConfigIface && m_client->dataStorage()->getChatInfo(&info, m_targetPeer)) {
+        m_roomConfigIface->setTitle(info.title());
+        m_roomConfigIface->setConfigurationRetrieved(true);
     }
 }
 
-void MorseTextChannel::setMessageInboxRead(Telegram::Peer peer, quint32 messageId)
+void MorseTextChannel::setMessageInboxRead(quint32 messageId)
 {
-    // We are connected to broadcast signal, so have to select only needed calls
-    if (m_targetPeer != peer) {
-        return;
-    }
-
     // TODO: Mark *all* messages up to this as read
     QStringList tokens;
 
@@ -450,16 +446,11 @@ void MorseTextChannel::setMessageInboxRead(Telegram::Peer peer, quint32 messageI
 #endif
 }
 
-void MorseTextChannel::setMessageOutboxRead(Telegram::Peer peer, quint32 messageId)
+void MorseTextChannel::setMessageOutboxRead(quint32 messageId)
 {
-    // We are connected to broadcast signal, so have to select only needed calls
-    if (m_targetPeer != peer) {
-        return;
-    }
-
     // TODO: Mark *all* messages up to this as read
 
-    const QString token = m_connection->getMessageToken(peer, messageId);
+    const QString token = m_connection->getMessageToken(m_targetPeer, messageId);
 
     Tp::MessagePartList partList;
 
@@ -483,6 +474,14 @@ void MorseTextChannel::onMessageSent(quint64 messageRandomId, quint32 messageId)
 {
     Q_UNUSED(messageId)
 
+    for (PendingSend &pendingSend : m_pendingSends) {
+        if (messageRandomId && (pendingSend.randomId == messageRandomId)) {
+            m_connection->metrics()->record(MorseMetrics::SendLatency, pendingSend.timer);
+            pendingSend.randomId = 0;
+            break;
+        }
+    }
+
     const QString token = QString::number(messageRandomId);
 
     Tp::MessagePartList partList;
@@ -505,6 +504,7 @@ void MorseTextChannel::reactivateLocalTyping()
 
 void MorseTextChannel::setChatState(uint state, Tp::DBusError *error)
 {
+    MORSE_WATCHDOG_SCOPE();
     Q_UNUSED(error);
 
     if (!m_localTypingTimer) {
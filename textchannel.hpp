@@ -20,6 +20,7 @@
 #ifndef MORSE_TEXTCHANNEL_HPP
 #define MORSE_TEXTCHANNEL_HPP
 
+#include <QElapsedTimer>
 #include <QPointer>
 
 #include <TelegramQt/TelegramNamespace>
@@ -61,20 +62,19 @@ public:
     quint32 getMessageId(const QString &token) const;
 
 public slots:
-    void onMessageActionChanged(const Telegram::Peer &peer, quint32 userId, const Telegram::MessageAction &action);
     void setMessageAction(quint32 userId, const Telegram::MessageAction &action);
     void onMessageReceived(const Telegram::Message &message);
     void onMessageSent(quint64 messageRandomId, quint32 messageId);
     void updateChatParticipants(const Tp::UIntList &handles);
 
-    void onChatDetailsChanged(const Telegram::Peer &peer, const Tp::UIntList &handles);
+    void updateChatDetails(const Tp::UIntList &handles);
+    void setMessageInboxRead(quint32 messageId);
+    void setMessageOutboxRead(quint32 messageId);
 
 signals:
     void messageAcknowledged(const Telegram::Peer &peer, quint32 messageId);
 
 protected slots:
-    void setMessageInboxRead(Telegram::Peer peer, quint32 messageId);
-    void setMessageOutboxRead(Telegram::Peer peer, quint32 messageId);
     void updateDialogInfo();
     void reactivateLocalTyping();
 
@@ -103,6 +103,15 @@ private:
 
     QTimer *m_localTypingTimer;
 
+    struct PendingSend
+    {
+        quint64 randomId = 0;
+        QElapsedTimer timer; // Since sendMessageCallback()
+    };
+    // The confirmation never comes for a failed message, so the oldest entry is reused
+    PendingSend m_pendingSends[32];
+    int m_nextPendingSend = 0;
+
 };
 
 #endif // MORSE_TEXTCHANNEL_HPP
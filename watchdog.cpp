@@ -0,0 +1,173 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "watchdog.hpp"
+#include "logging.hpp"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QStringList>
+#include <QTimer>
+#include <QVariantMap>
+
+MorseWatchdog *MorseWatchdog::s_instance = nullptr;
+
+bool MorseWatchdog::enable(int threshold)
+{
+    if (s_instance || (threshold <= 0)) {
+        return false;
+    }
+    s_instance = new MorseWatchdog(threshold, QCoreApplication::instance());
+    connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, s_instance, &MorseWatchdog::stop);
+    s_instance->start(QThread::HighPriority);
+    qCInfo(lcMorseConnection) << "Main loop watchdog started with" << threshold << "ms threshold";
+    return true;
+}
+
+MorseWatchdog::MorseWatchdog(int threshold, QObject *parent) :
+    QThread(parent),
+    m_threshold(threshold),
+    m_interval(qMax(10, threshold / 4)),
+    m_beatTimer(new QTimer(this))
+{
+    setObjectName(QStringLiteral("MorseWatchdog"));
+    m_clock.start();
+    m_lastBeat.storeRelease(m_clock.elapsed());
+
+    // The timer lives in the main thread, unlike the watchdog thread itself
+    m_beatTimer->setInterval(m_interval);
+    connect(m_beatTimer, &QTimer::timeout, this, &MorseWatchdog::beat);
+    m_beatTimer->start();
+}
+
+MorseWatchdog::~MorseWatchdog()
+{
+    stop();
+    if (s_instance == this) {
+        s_instance = nullptr;
+    }
+}
+
+void MorseWatchdog::stop()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopRequested = true;
+        m_stopCondition.wakeAll();
+    }
+    m_beatTimer->stop();
+    wait();
+}
+
+void MorseWatchdog::enter(const char *name)
+{
+    const int depth = m_depth.loadAcquire();
+    if (depth < MaxScopeDepth) {
+        m_scopes[depth].storeRelease(name);
+    }
+    m_depth.storeRelease(depth + 1);
+}
+
+void MorseWatchdog::leave()
+{
+    m_depth.storeRelease(m_depth.loadAcquire() - 1);
+}
+
+QString MorseWatchdog::activeScopes() const
+{
+    // The names are static strings, so a racy read yields a stale but valid pointer
+    const int depth = qMin<int>(m_depth.loadAcquire(), MaxScopeDepth);
+    QStringList names;
+    for (int i = 0; i < depth; ++i) {
+        names.append(QLatin1String(m_scopes[i].loadAcquire()));
+    }
+    return names.join(QStringLiteral(" > "));
+}
+
+void MorseWatchdog::run()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_stopRequested) {
+        m_stopCondition.wait(&m_mutex, m_interval);
+        if (m_stopRequested) {
+            break;
+        }
+        const qint64 late = m_clock.elapsed() - m_lastBeat.loadAcquire() - m_interval;
+        if ((late <= m_threshold) || m_stalled) {
+            continue;
+        }
+        // Sample the scope while the main loop is still blocked
+        m_stalled = true;
+        m_stallScope = activeScopes();
+    }
+}
+
+void MorseWatchdog::beat()
+{
+    const qint64 now = m_clock.elapsed();
+    const qint64 previous = m_lastBeat.fetchAndStoreRelease(now);
+    const qint64 duration = now - previous - m_interval;
+
+    QMutexLocker locker(&m_mutex);
+    const bool sampled = m_stalled;
+    m_stalled = false;
+    if (duration <= m_threshold) {
+        return;
+    }
+
+    Stall stall;
+    stall.timestamp = QDateTime::currentMSecsSinceEpoch() - (now - previous);
+    stall.duration = duration;
+    if (sampled) {
+        stall.scope = m_stallScope;
+    }
+    if (m_stalls.count() < MaxStalls) {
+        m_stalls.append(stall);
+    } else {
+        m_stalls[m_nextStall] = stall;
+    }
+    m_nextStall = (m_nextStall + 1) % MaxStalls;
+    locker.unlock();
+
+    qCWarning(lcMorseConnection) << "Main loop stalled for" << duration << "ms in"
+                                 << (stall.scope.isEmpty() ? QStringLiteral("an unknown scope") : stall.scope);
+}
+
+QVector<MorseWatchdog::Stall> MorseWatchdog::recentStalls() const
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_stalls.count() < MaxStalls) {
+        return m_stalls;
+    }
+    // Oldest first
+    return m_stalls.mid(m_nextStall) + m_stalls.mid(0, m_nextStall);
+}
+
+QVariantList MorseWatchdog::recentStallsToVariantList() const
+{
+    QVariantList result;
+    for (const Stall &stall : recentStalls()) {
+        QVariantMap entry;
+        entry.insert(QLatin1String("timestamp"), stall.timestamp);
+        entry.insert(QLatin1String("duration"), stall.duration);
+        entry.insert(QLatin1String("scope"), stall.scope);
+        result.append(entry);
+    }
+    return result;
+}
@@ -0,0 +1,126 @@
+/*
+    This file is part of the telepathy-morse connection manager.
+    Copyright (C) 2026 The telepathy-morse contributors
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MORSE_WATCHDOG_HPP
+#define MORSE_WATCHDOG_HPP
+
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QThread>
+#include <QVariantList>
+#include <QVector>
+#include <QWaitCondition>
+
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
+/**
+ * Main loop stall detector.
+ *
+ * A main thread timer stamps a heartbeat; the watchdog thread notices when the heartbeat
+ * is late by more than threshold() and samples the active Scope stack, i.e. the morse
+ * callback or slot blocking the loop. The stall is recorded with its start time and duration
+ * once the loop resumes. The watchdog is opt-in (see enable()); while it is not running
+ * a Scope costs a single pointer check.
+ */
+class MorseWatchdog : public QThread
+{
+    Q_OBJECT
+public:
+    struct Stall
+    {
+        qint64 timestamp = 0; // ms since epoch
+        qint64 duration = 0; // ms
+        QString scope; // Outermost first, empty if no scope was active
+    };
+
+    // Main thread only
+    class Scope
+    {
+    public:
+        explicit Scope(const char *name);
+        ~Scope();
+
+    protected:
+        MorseWatchdog *m_watchdog;
+    };
+
+    static MorseWatchdog *instance() { return s_instance; }
+    static bool enable(int threshold);
+
+    int threshold() const { return m_threshold; }
+    QVector<Stall> recentStalls() const;
+    QVariantList recentStallsToVariantList() const;
+
+protected:
+    explicit MorseWatchdog(int threshold, QObject *parent = nullptr);
+    ~MorseWatchdog() override;
+
+    void run() override;
+    void stop();
+    void beat();
+    QString activeScopes() const;
+
+    void enter(const char *name);
+    void leave();
+
+    enum {
+        MaxScopeDepth = 16,
+        MaxStalls = 32,
+    };
+
+    static MorseWatchdog *s_instance;
+
+    int m_threshold; // ms
+    int m_interval; // ms between the heartbeats and the checks
+    QTimer *m_beatTimer = nullptr;
+    QElapsedTimer m_clock;
+    QAtomicInteger<qint64> m_lastBeat; // m_clock time of the last heartbeat
+
+    QAtomicPointer<const char> m_scopes[MaxScopeDepth];
+    QAtomicInt m_depth;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_stopCondition;
+    bool m_stopRequested = false;
+    bool m_stalled = false; // The current stall is already sampled
+    QString m_stallScope;
+    QVector<Stall> m_stalls; // Ring buffer
+    int m_nextStall = 0;
+};
+
+#define MORSE_WATCHDOG_SCOPE() MorseWatchdog::Scope morseWatchdogScope(Q_FUNC_INFO)
+
+inline MorseWatchdog::Scope::Scope(const char *name) :
+    m_watchdog(MorseWatchdog::s_instance)
+{
+    if (m_watchdog) {
+        m_watchdog->enter(name);
+    }
+}
+
+inline MorseWatchdog::Scope::~Scope()
+{
+    if (m_watchdog) {
+        m_watchdog->leave();
+    }
+}
+
+#endif // MORSE_WATCHDOG_HPP